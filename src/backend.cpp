@@ -23,9 +23,15 @@
 
 #include "backend.h"
 #include "progress.h"
+#include "threadpool.h"
 
-#include <libstrings.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include <stdexcept>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
 #include <boost/locale.hpp>
 #include <pugixml.hpp>
 
@@ -33,113 +39,221 @@ using namespace std;
 using boost::locale::translate;
 
 namespace stredit {
-    //String file reading.
-    void GetStrings(const std::string path, const int fallbackEnc, boost::unordered_map<uint32_t, std::string>& stringMap) {
-        uint32_t ret;
-        strings_handle sh;
-        string_data * strings;
-        size_t numStrings = 0;
+    static uint32_t ReadUint32(const char * data) {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
 
-        ret = OpenStringsFile(&sh, reinterpret_cast<const uint8_t *>(path.c_str()), fallbackEnc);
+    static void WriteUint32(char * data, const uint32_t value) {
+        memcpy(data, &value, sizeof(value));
+    }
 
-        if (ret != LIBSTRINGS_OK)
-            throw runtime_error(translate("Could not open strings file."));
+    //Maps the IDs of a file's strings to the strings.
+    static void GetStringMap(const StringsFile& file, boost::unordered_map<uint32_t, boost::string_ref>& stringMap) {
+        const vector<StringsFile::entry>& entries = file.GetEntries();
+        stringMap.clear();
+        stringMap.reserve(entries.size());
+        for (vector<StringsFile::entry>::const_iterator it=entries.begin(), endIt=entries.end(); it != endIt; ++it)
+            stringMap.insert(pair<uint32_t, boost::string_ref>(it->id, it->str));
+    }
 
-        ret = GetStrings(sh, &strings, &numStrings);
+    //The string written out for a string in a list: its new string if it has
+    //one, otherwise its original string.
+    static boost::string_ref GetOutputString(const StringTable& stringList, const size_t i) {
+        return stringList.HasNewString(i) ? stringList.GetNewString(i) : stringList.GetOldString(i);
+    }
 
-        if (ret != LIBSTRINGS_OK) {
-            CloseStringsFile(sh);
-            throw runtime_error(translate("Could not read strings file."));
+    //String file reading. The table's buffer is sized first, so it only
+    //needs allocating once.
+    void GetStrings(const StringsFile& file, StringTable& stringList) {
+        const vector<StringsFile::entry>& entries = file.GetEntries();
+        size_t bytes = 0;
+        for (vector<StringsFile::entry>::const_iterator it=entries.begin(), endIt=entries.end(); it != endIt; ++it)
+            bytes += it->str.length();
+
+        StringTable newList;
+        newList.Reserve(entries.size(), bytes);
+        for (vector<StringsFile::entry>::const_iterator it=entries.begin(), endIt=entries.end(); it != endIt; ++it)
+            newList.Append(it->id, it->str);
+        stringList.swap(newList);
+    }
+
+    //Opens one strings file for OpenStringsFiles.
+    struct open_file_task {
+        open_file_task(StringsFile * file, const std::string& path, const int fallbackEnc, const CancelToken * cancel, ProgressState * progress)
+            : file(file), path(path), fallbackEnc(fallbackEnc), cancel(cancel), progress(progress) {}
+
+        void operator () () const {
+            CancelToken::Check(cancel);
+            file->Open(path, fallbackEnc);
+            if (progress != NULL)
+                progress->Advance();
         }
 
-        stringMap.clear();
-        for (size_t i=0; i < numStrings; ++i) {
-            stringMap.insert(pair<uint32_t, string>(strings[i].id, string(reinterpret_cast<const char *>(strings[i].data))));
+        StringsFile * file;
+        std::string path;
+        int fallbackEnc;
+        const CancelToken * cancel;
+        ProgressState * progress;
+    };
+
+    //Most of the time spent opening a file goes on faulting in its pages and
+    //checking its strings' encoding, so files are opened in parallel. The
+    //output order doesn't depend on which finishes first.
+    void OpenStringsFiles(const std::vector<std::string>& paths,
+                          const std::vector<int>& fallbackEncs,
+                          boost::ptr_vector<StringsFile>& files,
+                          const CancelToken * cancel,
+                          ProgressState * progress) {
+        boost::ptr_vector<StringsFile> newFiles;
+        for (size_t i=0, max=paths.size(); i < max; ++i)
+            newFiles.push_back(new StringsFile());
+
+        {
+            WorkStealingPool pool(min<size_t>(paths.size(), boost::thread::hardware_concurrency()));
+            for (size_t i=0, max=paths.size(); i < max; ++i)
+                pool.Submit(open_file_task(&newFiles[i], paths[i], fallbackEncs[i], cancel, progress));
+            pool.Wait();
         }
 
-        CloseStringsFile(sh);
+        files.swap(newFiles);
     }
 
-    void GetStrings(const std::string path, const int fallbackEnc, std::vector<str_data>& stringList) {
-        uint32_t ret;
-        strings_handle sh;
-        string_data * strings;
-        size_t numStrings = 0;
-
-        ret = OpenStringsFile(&sh, reinterpret_cast<const uint8_t *>(path.c_str()), fallbackEnc);
-
-        if (ret != LIBSTRINGS_OK)
-            throw runtime_error(translate("Could not open strings file."));
-
-        ret = GetStrings(sh, &strings, &numStrings);
+    //String file writing. The whole file is laid out in one buffer, which is
+    //written to a temporary file that then replaces the file at path, so a
+    //failed save leaves the original intact.
+    void SetStrings(const std::string path, const StringTable& stringList, const CancelToken * cancel) {
+        const bool lengthPrefixed = HasLengthPrefixes(path);
+        const size_t prefixSize = lengthPrefixed ? sizeof(uint32_t) : 0;
+        const size_t count = stringList.size();
+
+        //Size the buffer first, so it only needs allocating once.
+        const size_t dataStart = 2 * sizeof(uint32_t) + count * 2 * sizeof(uint32_t);
+        size_t size = dataStart;
+        for (size_t i=0; i < count; ++i)
+            size += prefixSize + GetOutputString(stringList, i).length() + 1;
+        if (size - dataStart > numeric_limits<uint32_t>::max())
+            throw runtime_error(translate("Could not write strings file."));
 
-        if (ret != LIBSTRINGS_OK) {
-            CloseStringsFile(sh);
-            throw runtime_error(translate("Could not read strings file."));
+        std::string buffer(size, '\0');
+        char * directory = &buffer[0] + 2 * sizeof(uint32_t);
+        char * data = &buffer[0] + dataStart;
+        WriteUint32(&buffer[0], count);
+        WriteUint32(&buffer[0] + sizeof(uint32_t), size - dataStart);
+        size_t offset = 0;
+        for (size_t i=0; i < count; ++i) {
+            const boost::string_ref str = GetOutputString(stringList, i);
+            WriteUint32(directory + i * 2 * sizeof(uint32_t), stringList.GetId(i));
+            WriteUint32(directory + i * 2 * sizeof(uint32_t) + sizeof(uint32_t), offset);
+            if (lengthPrefixed)
+                WriteUint32(data + offset, str.length() + 1);
+            if (!str.empty())
+                memcpy(data + offset + prefixSize, str.data(), str.length());
+            offset += prefixSize + str.length() + 1;  //The buffer is already null.
         }
 
-        stringList.clear();
-        for (size_t i=0; i < numStrings; ++i) {
-            str_data data;
-            data.id = strings[i].id;
-            data.oldString = string(reinterpret_cast<const char *>(strings[i].data));
-            stringList.push_back(data);
+        const boost::filesystem::path tempPath = path + ".tmp";
+        boost::filesystem::ofstream out(tempPath, ios::binary | ios::trunc);
+        out.write(buffer.data(), buffer.length());
+        out.close();
+        if (out.fail())
+            throw runtime_error(translate("Could not write strings file."));
+
+        //This is the last chance to cancel without changing the file.
+        boost::system::error_code ec;
+        if (cancel != NULL && cancel->IsCancelled()) {
+            boost::filesystem::remove(tempPath, ec);
+            CancelToken::Check(cancel);
         }
 
-        CloseStringsFile(sh);
+        boost::filesystem::rename(tempPath, path, ec);
+        if (ec)
+            throw runtime_error(translate("Could not write strings file."));
     }
 
-    //String file writing.
-    void SetStrings(const std::string path, const std::vector<str_data>& stringList) {
-        uint32_t ret;
-        strings_handle sh;
-        string_data * strings;
-        size_t numStrings;
-
-        ret = OpenStringsFile(&sh, reinterpret_cast<const uint8_t *>(path.c_str()), 1252);
-
-        if (ret != LIBSTRINGS_OK)
-            throw runtime_error(translate("Could not open strings file."));
-
-        //Create string_data array.
-        numStrings = stringList.size();
-        strings = new string_data[numStrings];
-        size_t i = 0;
-        for (std::vector<str_data>::const_iterator it=stringList.begin(), endIt=stringList.end(); it != endIt; ++it) {
-            string_data data;
-            data.id = it->id;
-            if (it->newString.empty())
-                data.data = ToUint8_tString(it->oldString);
-            else
-                data.data = ToUint8_tString(it->newString);
-            strings[i] = data;
-            ++i;
-        }
-
-        ret = SetStrings(sh, strings, numStrings);
+    //Appended strings are written before the header and directory are updated
+    //to use them, so an interrupted update leaves the file readable, though
+    //the file size check means the next save will rewrite it.
+    bool UpdateStrings(const std::string path, const StringTable& stringList, const CancelToken * cancel) {
+        boost::filesystem::fstream file(path, ios::in | ios::out | ios::binary);
+        char header[2 * sizeof(uint32_t)];
+        file.read(header, sizeof(header));
+        if (!file.good())
+            return false;
 
-        //Free memory allocated for string_data array.
-        for (size_t i=0; i < numStrings; i++)
-            delete [] strings[i].data;
-        delete [] strings;
+        const size_t count = ReadUint32(header);
+        const size_t dataSize = ReadUint32(header + sizeof(uint32_t));
+        const size_t dataStart = sizeof(header) + count * 2 * sizeof(uint32_t);
+        boost::system::error_code ec;
+        if (count != stringList.size() || boost::filesystem::file_size(path, ec) != dataStart + dataSize || ec)
+            return false;
 
-        if (ret != LIBSTRINGS_OK) {
-            CloseStringsFile(sh);
-            throw runtime_error(translate("Could not set new strings."));
+        boost::unordered_map<uint32_t, size_t> editedStrings;  //Maps IDs to positions in stringList.
+        const size_t prefixSize = HasLengthPrefixes(path) ? sizeof(uint32_t) : 0;
+        size_t liveSize = 0;
+        for (size_t i=0; i < count; ++i) {
+            liveSize += prefixSize + GetOutputString(stringList, i).length() + 1;
+            if (stringList.IsEdited(i))
+                editedStrings.insert(pair<uint32_t, size_t>(stringList.GetId(i), i));
         }
+        if (editedStrings.empty())
+            return true;
 
-        ret = SaveStringsFile(sh, reinterpret_cast<const uint8_t *>(path.c_str()));
+        //Lay out the edited strings after the existing data, and find the
+        //directory entries that will point to them.
+        std::string directory(count * 2 * sizeof(uint32_t), '\0');
+        file.read(&directory[0], directory.length());
+        if (!file.good())
+            return false;
 
-        if (ret != LIBSTRINGS_OK) {
-            CloseStringsFile(sh);
-            throw runtime_error(translate("Could not write strings file."));
+        std::string data;
+        vector<pair<size_t, uint32_t> > newOffsets;  //Directory entry positions and their new offsets.
+        for (size_t i=0; i < count; ++i) {
+            boost::unordered_map<uint32_t, size_t>::const_iterator it = editedStrings.find(ReadUint32(&directory[i * 2 * sizeof(uint32_t)]));
+            if (it == editedStrings.end())
+                continue;
+
+            const boost::string_ref str = GetOutputString(stringList, it->second);
+            newOffsets.push_back(pair<size_t, uint32_t>(sizeof(header) + i * 2 * sizeof(uint32_t) + sizeof(uint32_t), dataSize + data.length()));
+            if (prefixSize > 0) {
+                char prefix[sizeof(uint32_t)];
+                WriteUint32(prefix, str.length() + 1);
+                data.append(prefix, sizeof(prefix));
+            }
+            data.append(str.data(), str.length());
+            data.push_back('\0');
         }
+        if (newOffsets.size() != editedStrings.size())
+            return false;  //The file doesn't have all the edited strings' IDs.
 
-        CloseStringsFile(sh);
+        //Compact the file once more than a quarter of its string data isn't used.
+        const size_t newDataSize = dataSize + data.length();
+        if (newDataSize > numeric_limits<uint32_t>::max() || newDataSize > liveSize + liveSize / 4)
+            return false;
+
+        CancelToken::Check(cancel);
+
+        file.seekp(dataStart + dataSize);
+        file.write(data.data(), data.length());
+        file.flush();
+        WriteUint32(header + sizeof(uint32_t), newDataSize);
+        file.seekp(sizeof(uint32_t));
+        file.write(header + sizeof(uint32_t), sizeof(uint32_t));
+        for (vector<pair<size_t, uint32_t> >::const_iterator it=newOffsets.begin(), endIt=newOffsets.end(); it != endIt; ++it) {
+            char offset[sizeof(uint32_t)];
+            WriteUint32(offset, it->second);
+            file.seekp(it->first);
+            file.write(offset, sizeof(offset));
+        }
+        file.close();
+        if (file.fail())
+            throw runtime_error(translate("Could not write strings file."));
+        return true;
     }
 
     //Import/Export strings as XML data.
-    void ImportAsXML(const std::string path,       std::vector<str_data>& stringList) {
+    void ImportAsXML(const std::string path,       StringTable& stringList, const CancelToken * cancel) {
 
         using namespace pugi;
 
@@ -149,19 +263,17 @@ namespace stredit {
 
         if (!result)
             throw runtime_error(translate("Could not read XML file."));
+        CancelToken::Check(cancel);
 
         xml_node strings = doc.child("strings");
 
-        stringList.clear();
-        for (xml_node string = strings.child("string"); string; string = string.next_sibling("string")) {
-            str_data data;
-            data.id = string.attribute("id").as_int();
-            data.oldString = string.text().get();
-            stringList.push_back(data);
-        }
+        StringTable newList;
+        for (xml_node string = strings.child("string"); string; string = string.next_sibling("string"))
+            newList.Append(string.attribute("id").as_int(), string.text().get());
+        stringList.swap(newList);
     }
 
-    void ExportAsXML(const std::string path, const std::vector<str_data>& stringList) {
+    void ExportAsXML(const std::string path, const StringTable& stringList, const CancelToken * cancel) {
 
         using namespace pugi;
 
@@ -172,147 +284,418 @@ namespace stredit {
         topNode.set_name("strings");
 
         for (int i=0, max=stringList.size(); i < max; ++i) {
+            CancelToken::Check(cancel);
             xml_node strNode = topNode.append_child();
 
             strNode.set_name("string");
 
             xml_attribute id = strNode.append_attribute("id");
-            id.set_value(stringList[i].id);
+            id.set_value(stringList.GetId(i));
 
-            string str;
-            if (stringList[i].newString.empty())
-                str = stringList[i].oldString;
-            else
-                str = stringList[i].newString;
-            strNode.text().set(str.c_str());
+            strNode.text().set(GetOutputString(stringList, i).to_string().c_str());
         }
 
+        CancelToken::Check(cancel);
         if (!doc.save_file(path.c_str()))
             throw runtime_error(translate("Could not write XML file."));
     }
 
-    //Matches the strings in the maps by their IDs. Any IDs which are not present in both maps
-    //are not included in the output. The passed vector has its contents appended to, not replaced.
-    void BuildStringPairs(const boost::unordered_map<uint32_t, std::string>& originalStrMap,
-                           const boost::unordered_map<uint32_t, std::string>& targetStrMap,
-                           boost::unordered_map<std::string, std::string>& stringMap) {
-        boost::unordered_map<uint32_t, std::string>::const_iterator itr;
-        for (boost::unordered_map<uint32_t, std::string>::const_iterator it=originalStrMap.begin(), endIt=originalStrMap.end(); it != endIt; ++it) {
-            itr = targetStrMap.find(it->first);
+    //Matches the strings in the files by their IDs. Any IDs which are not present in both files
+    //are not included in the output. The passed map has its contents appended to, not replaced.
+    void BuildStringPairs(const StringsFile& originalFile,
+                          const StringsFile& targetFile,
+                          boost::unordered_map<std::string, std::string>& stringMap) {
+        boost::unordered_map<uint32_t, boost::string_ref> targetStrMap;
+        GetStringMap(targetFile, targetStrMap);
+
+        //When a source string has different translations under different IDs, the first one
+        //inserted is kept. The original strings are walked in the order of a map of them
+        //built in the same way as it always has been, without reserving space, so that the
+        //same translation is kept as before, and with it the same vocabulary fingerprint.
+        boost::unordered_map<uint32_t, boost::string_ref> originalStrMap;
+        const vector<StringsFile::entry>& entries = originalFile.GetEntries();
+        for (vector<StringsFile::entry>::const_iterator it=entries.begin(), endIt=entries.end(); it != endIt; ++it)
+            originalStrMap.insert(pair<uint32_t, boost::string_ref>(it->id, it->str));
+
+        for (boost::unordered_map<uint32_t, boost::string_ref>::const_iterator it=originalStrMap.begin(), endIt=originalStrMap.end(); it != endIt; ++it) {
+            boost::unordered_map<uint32_t, boost::string_ref>::const_iterator itr = targetStrMap.find(it->first);
             if (itr != targetStrMap.end())
-                stringMap.insert(pair<string, string>(it->second, itr->second));
+                stringMap.insert(pair<string, string>(it->second.to_string(), itr->second.to_string()));
         }
     }
 
-    //Matches the strings of map1 and map2 up using their IDs, and outputs the
-    //result. The lDist for all matches is 0, as only exact matching is used.
-    void BuildStringData(const boost::unordered_map<uint32_t, std::string>& originalStrMap,
-                           const boost::unordered_map<uint32_t, std::string>& targetStrMap,
-                           std::vector<str_data>& stringList) {
-        stringList.clear();
-        boost::unordered_map<uint32_t, std::string>::const_iterator itr;
-        for (boost::unordered_map<uint32_t, std::string>::const_iterator it=originalStrMap.begin(), endIt=originalStrMap.end(); it != endIt; ++it) {
-            str_data data;
-            data.id = it->first;
-            data.oldString = it->second;
-            itr = targetStrMap.find(it->first);
-            if (itr != targetStrMap.end() && it->second != itr->second)
-                data.newString = itr->second;
-            stringList.push_back(data);
+    //Matches the strings of the files up using their IDs, and outputs the
+    //result.
+    void BuildStringData(const StringsFile& originalFile,
+                         const StringsFile& targetFile,
+                         StringTable& stringList) {
+        boost::unordered_map<uint32_t, boost::string_ref> targetStrMap;
+        GetStringMap(targetFile, targetStrMap);
+
+        GetStrings(originalFile, stringList);
+        for (size_t i=0, max=stringList.size(); i < max; ++i) {
+            boost::unordered_map<uint32_t, boost::string_ref>::const_iterator itr = targetStrMap.find(stringList.GetId(i));
+            if (itr != targetStrMap.end() && stringList.GetOldString(i) != itr->second)
+                stringList.SetNewString(i, itr->second);
         }
     }
 
-    //Fills in the empty newStrings in stringList by finding the closest Levenshtein match between
-    //their corresponding oldStrings and the keys of stringMap, then using the corresponding
-    //mapped string.
-    void FuzzyMatchStrings(const boost::unordered_map<std::string, std::string>& stringMap,
-                                 std::vector<str_data>& stringList,
-                                 void * progDiaPtr) {
-        const int num = stringList.size();
-        int i = 1;
-        boost::unordered_map<std::string, std::string>::const_iterator bestMatch;
-        for (std::vector<str_data>::iterator it=stringList.begin(), endIt=stringList.end(); it != endIt; ++it) {
-            if (it->newString.empty()) {
-                bestMatch = stringMap.find(it->oldString);
-                int leastDist = 0;
-                if (bestMatch == stringMap.end()) {
-                    leastDist = -1;
-                    for (boost::unordered_map<std::string, std::string>::const_iterator itr=stringMap.begin(), endItr=stringMap.end(); itr != endItr; ++itr) {
-                        int dist = Levenshtein(it->oldString, itr->first);
-                        if (leastDist == -1 || leastDist > dist) {
-                            bestMatch = itr;
-                            leastDist = dist;
-                            if (dist == 1)  //Closest non-exact match possible.
-                                break;
-                        }
-                    }
-                }
-                if (bestMatch != stringMap.end()) {
-                    //bestMatch now points to the best matching element of stringMap.
-                    it->newString = bestMatch->second;
-                    it->fuzzy = (leastDist != 0);
-                }
+    //Gives the translation of the closest vocabulary entry to all the strings
+    //in a range of positions in a string list, and the entries found as their
+    //suggestions, then tells matched about them. Similarity is the distance as
+    //a fraction of the most edits the strings could need. The string list is
+    //written to by several threads, so the mutex is locked while it is, and
+    //while the strings written are read back for matched.
+    static void ApplyMatches(const FuzzyIndex& vocabIndex, const fuzzy_match * matches, const size_t found, StringTable& stringList,
+                             boost::mutex& mutex, MatchedStrings * matched, const size_t * first, const size_t * last) {
+        if (found == 0)
+            return;
+
+        const size_t length = stringList.GetOldString(*first).length();
+        vector<fuzzy_suggestion> suggestions(found);
+        for (size_t i=0; i < found; ++i) {
+            const boost::string_ref source = vocabIndex.GetKey(matches[i].entry);
+            const boost::string_ref translation = vocabIndex.GetValue(matches[i].entry);
+            const size_t maxDist = max(source.length(), length);
+            suggestions[i].source.assign(source.data(), source.length());
+            suggestions[i].translation.assign(translation.data(), translation.length());
+            suggestions[i].dist = matches[i].dist;
+            suggestions[i].similarity = (maxDist == 0) ? 1 : 1 - (float)matches[i].dist / maxDist;
+        }
+
+        boost::lock_guard<boost::mutex> lock(mutex);
+        for (const size_t * it=first; it != last; ++it) {
+            stringList.SetNewString(*it, suggestions[0].translation);
+            stringList.SetFuzzy(*it, matches[0].dist != 0);
+            stringList.SetSuggestions(*it, suggestions);
+        }
+        if (matched != NULL)
+            matched->Add(stringList, first, last);
+    }
+
+    //Matches one distinct original string against the vocabulary for
+    //FuzzyMatchStrings, then gives the result to all the strings in the range.
+    //Tasks that start after the operation is cancelled skip the match. The
+    //original strings aren't changed while matching, so are read unlocked.
+    struct fuzzy_match_task {
+        fuzzy_match_task(const FuzzyIndex * vocabIndex, const size_t count, MatchCache * cache, const CancelToken * cancel, MatchedStrings * matched,
+                         StringTable * stringList, boost::mutex * mutex, const size_t * first, const size_t * last, ProgressState * progress)
+            : vocabIndex(vocabIndex), count(count), cache(cache), cancel(cancel), matched(matched), stringList(stringList), mutex(mutex), first(first), last(last), progress(progress) {}
+
+        void operator () () const {
+            if (cancel == NULL || !cancel->IsCancelled()) {
+                const boost::string_ref oldString = stringList->GetOldString(*first);
+                vector<fuzzy_match> matches(count);
+                const size_t found = vocabIndex->FindBestMatches(oldString, count, &matches[0]);
+                ApplyMatches(*vocabIndex, &matches[0], found, *stringList, *mutex, matched, first, last);
+                if (cache != NULL)
+                    cache->Add(oldString, count, &matches[0], found);
             }
-            update_progress(progDiaPtr, "", ((float)i / num) * 100);
-            ++i;
+            if (progress != NULL)
+                progress->Advance(last - first);
+        }
+
+        const FuzzyIndex * vocabIndex;
+        size_t count;
+        MatchCache * cache;
+        const CancelToken * cancel;
+        MatchedStrings * matched;
+        StringTable * stringList;
+        boost::mutex * mutex;
+        const size_t * first;
+        const size_t * last;
+        ProgressState * progress;
+    };
+
+    //Whether cached matches are all entries of the index.
+    static bool ValidMatches(const FuzzyIndex& vocabIndex, const fuzzy_match * matches, const size_t found) {
+        for (size_t i=0; i < found; ++i) {
+            if (matches[i].entry >= vocabIndex.size())
+                return false;
         }
+        return true;
     }
 
-    //Explicit memory management, need to call delete on the output when finished with it.
-    uint8_t * ToUint8_tString(const std::string str) {
-        size_t length = str.length() + 1;
-        uint8_t * p = new uint8_t[length];
+    //Sorts positions in a string list longest original string first, with
+    //identical strings next to each other.
+    struct compare_length_descending {
+        explicit compare_length_descending(const StringTable& stringList) : stringList(stringList) {}
+
+        bool operator () (const size_t first, const size_t second) const {
+            const boost::string_ref firstString = stringList.GetOldString(first);
+            const boost::string_ref secondString = stringList.GetOldString(second);
+            if (firstString.length() != secondString.length())
+                return firstString.length() > secondString.length();
+            return firstString < secondString;
+        }
+
+        const StringTable& stringList;
+    };
 
-        for (size_t j=0; j < str.length(); j++) {  //UTF-8, so this is code-point by code-point rather than char by char, but same result here.
-            p[j] = str[j];
+    //Fills in the empty new strings in stringList by finding the closest Levenshtein match between
+    //their corresponding original strings and the keys indexed by vocabIndex, then using the corresponding
+    //mapped string.
+    fuzzy_match_stats FuzzyMatchStrings(const FuzzyIndex& vocabIndex,
+                                              StringTable& stringList,
+                                              const size_t suggestionCount,
+                                              MatchCache * cache,
+                                              const CancelToken * cancel,
+                                              MatchedStrings * matched,
+                                              ProgressState * progress) {
+        //String tables repeat a lot of strings, so group identical strings
+        //together and only match each distinct string once. Each match is
+        //independent of the others, so they can be found in parallel without
+        //affecting the results. Long strings take much longer to match, so
+        //they are queued first, leaving the short ones to even out the
+        //workers' loads at the end.
+        vector<size_t> untranslated;
+        for (size_t i=0, max=stringList.size(); i < max; ++i) {
+            if (!stringList.HasNewString(i))
+                untranslated.push_back(i);
+        }
+        sort(untranslated.begin(), untranslated.end(), compare_length_descending(stringList));
+
+        fuzzy_match_stats stats;
+        stats.untranslated = untranslated.size();
+        const size_t count = max<size_t>(suggestionCount, 1);
+        vector<fuzzy_match> matches(count);
+
+        if (progress != NULL)
+            progress->Start(translate("Translating strings..."), untranslated.size());
+
+        boost::mutex mutex;
+        WorkStealingPool pool;
+        for (size_t i=0, max=untranslated.size(); i < max && (cancel == NULL || !cancel->IsCancelled()); ) {
+            const boost::string_ref oldString = stringList.GetOldString(untranslated[i]);
+            size_t groupEnd = i + 1;
+            while (groupEnd < max && stringList.GetOldString(untranslated[groupEnd]) == oldString)
+                ++groupEnd;
+
+            //Cached results are cheap to look up, so aren't worth queueing.
+            size_t found;
+            if (cache != NULL && cache->Find(oldString, count, &matches[0], found) && ValidMatches(vocabIndex, &matches[0], found)) {
+                ApplyMatches(vocabIndex, &matches[0], found, stringList, mutex, matched, &untranslated[0] + i, &untranslated[0] + groupEnd);
+                if (progress != NULL)
+                    progress->Advance(groupEnd - i);
+                ++stats.cached;
+            } else
+                pool.Submit(fuzzy_match_task(&vocabIndex, count, cache, cancel, matched, &stringList, &mutex, &untranslated[0] + i, &untranslated[0] + groupEnd, progress));
+            ++stats.unique;
+            i = groupEnd;
         }
-        p[length - 1] = '\0';
-        return p;
+
+        pool.Wait();
+
+        return stats;
     }
 
-    //Calculate the Levenshtein distance between two strings.
-    //Code from <https://en.wikibooks.org/wiki/Algorithm_Implementation/Strings/Levenshtein_distance#C.2B.2B>
-    //Used under the CC-BY-SA 3.0 license: <http://creativecommons.org/licenses/by-sa/3.0/>
-    int Levenshtein(const std::string s1, const std::string s2) {
-        const size_t len1 = s1.size(), len2 = s2.size();
+    void MatchedStrings::Add(const StringTable& stringList, const size_t * first, const size_t * last) {
+        vector<matched_string> newStrings(last - first);
+        for (size_t i=0, max=newStrings.size(); i < max; ++i) {
+            newStrings[i].position = first[i];
+            newStrings[i].newString = stringList.GetNewString(first[i]).to_string();
+            newStrings[i].fuzzy = stringList.IsFuzzy(first[i]);
+            newStrings[i].suggestions = stringList.GetSuggestions(first[i]);
+        }
 
-        typedef unsigned int t;
+        boost::lock_guard<boost::mutex> lock(mutex);
+        strings.insert(strings.end(), newStrings.begin(), newStrings.end());
+    }
 
-        unsigned int * col = new t[ len2 + 1 ];
-        unsigned int * prevCol = new t[ len2 + 1];
+    void MatchedStrings::Take(std::vector<matched_string>& taken) {
+        taken.clear();
+        boost::lock_guard<boost::mutex> lock(mutex);
+        taken.swap(strings);
+    }
 
-        for (unsigned int i = 0; i < len2 + 1; i++) {
-            prevCol[i] = i;
+    //Strings are collated in chunks of this size on a pool of worker threads.
+    static const size_t collation_chunk_size = 4096;
+
+    //Makes the keys of the strings in [first, last) that are stale, or all of
+    //them if stale is NULL. If the global locale has no collator, each string
+    //is its own key, so strings sort bytewise.
+    static void MakeCollationKeyRange(const StringTable * stringList, const bool newStrings, const vector<bool> * stale,
+                                      string * keys, const size_t first, const size_t last) {
+        const locale loc;
+        const boost::locale::collator<char> * collator = NULL;
+        if (has_facet<boost::locale::collator<char> >(loc))
+            collator = &use_facet<boost::locale::collator<char> >(loc);
+        for (size_t i=first; i < last; ++i) {
+            if (stale != NULL && !(*stale)[i])
+                continue;
+            const boost::string_ref str = newStrings ? stringList->GetNewString(i) : stringList->GetOldString(i);
+            if (collator != NULL)
+                keys[i] = collator->transform(boost::locale::collator_base::tertiary, str.data(), str.data() + str.length());
+            else
+                keys[i].assign(str.data(), str.length());
         }
-        for (unsigned int i = 0; i < len1; i++) {
-            col[0] = i+1;
-            for (unsigned int j = 0; j < len2; j++) {
-                col[j+1] = min( min( 1 + col[j], 1 + prevCol[1 + j]), prevCol[j] + (s1[i]==s2[j] ? 0 : 1) );
+    }
+
+    static void MakeCollationKeys(const StringTable& stringList, const bool newStrings, const vector<bool> * stale, vector<string>& keys) {
+        if (keys.empty())
+            return;
+        else if (keys.size() <= collation_chunk_size) {
+            MakeCollationKeyRange(&stringList, newStrings, stale, &keys[0], 0, keys.size());
+            return;
+        }
+        WorkStealingPool pool;
+        for (size_t i=0, max=keys.size(); i < max; i += collation_chunk_size)
+            pool.Submit(boost::bind(MakeCollationKeyRange, &stringList, newStrings, stale, &keys[0], i, min(i + collation_chunk_size, max)));
+        pool.Wait();
+    }
+
+    void CollationKeys::Clear() {
+        oldKeys.clear();
+        newKeys.clear();
+        newStale.clear();
+    }
+
+    void CollationKeys::Invalidate(const size_t position) {
+        if (position < newStale.size())
+            newStale[position] = true;
+    }
+
+    void CollationKeys::Update(const StringTable& stringList, const sort_column column) {
+        if (column == sort_old && oldKeys.size() != stringList.size()) {
+            oldKeys.assign(stringList.size(), string());
+            MakeCollationKeys(stringList, false, NULL, oldKeys);
+        } else if (column == sort_new) {
+            if (newKeys.size() != stringList.size()) {
+                newKeys.assign(stringList.size(), string());
+                newStale.assign(stringList.size(), true);
             }
-            unsigned int * ptr = col;
-            col = prevCol;
-            prevCol = ptr;
+            if (find(newStale.begin(), newStale.end(), true) == newStale.end())
+                return;
+            MakeCollationKeys(stringList, true, &newStale, newKeys);
+            newStale.assign(newStale.size(), false);
         }
+    }
 
-        delete [] col;
-        delete [] prevCol;
-        return prevCol[len2];
+    const std::string& CollationKeys::GetOldKey(const size_t position) const {
+        return oldKeys[position];
     }
 
-    bool compare_old_new(const str_data first, const str_data second) {
-        //Untranslated strings first, followed by fuzzy matches, followed by all
-        //other strings. Within each group, sort alphabetically by the oldString.
-        if (first.newString.empty() && !second.newString.empty())
-            return true;
-        else if (!first.newString.empty() && second.newString.empty())
-            return false;
-        else if (first.fuzzy && !second.fuzzy)
-            return true;
-        else if (!first.fuzzy && second.fuzzy)
-            return false;
-        else if (first.oldString != second.oldString)
-            return first.oldString < second.oldString;
-        else
+    const std::string& CollationKeys::GetNewKey(const size_t position) const {
+        return newKeys[position];
+    }
+
+    //Tables larger than this are sorted in chunks on a pool of worker
+    //threads, which are then merged.
+    static const size_t parallel_sort_threshold = 65536;
+
+    //A string's place in the SortStrings() order, packed so that most
+    //comparisons don't need to read the strings. The prefix holds the first
+    //bytes of the original string, most significant first and zero padded,
+    //so that comparing prefixes compares those bytes.
+    struct sort_key {
+        uint64_t prefix;
+        uint32_t id;
+        uint32_t position;
+        uint8_t bucket;  //Untranslated strings first, then fuzzy strings before the rest.
+    };
+
+    static sort_key GetSortKey(const StringTable& stringList, const size_t position) {
+        sort_key key;
+        const boost::string_ref oldString = stringList.GetOldString(position);
+        const size_t length = min(oldString.length(), sizeof(key.prefix));
+        key.prefix = 0;
+        for (size_t i=0; i < length; ++i)
+            key.prefix |= uint64_t(static_cast<unsigned char>(oldString[i])) << (8 * (sizeof(key.prefix) - 1 - i));
+        key.id = stringList.GetId(position);
+        key.position = position;
+        key.bucket = (stringList.HasNewString(position) ? 2 : 0) + (stringList.IsFuzzy(position) ? 0 : 1);
+        return key;
+    }
+
+    //Strings with the same prefix are compared in full.
+    struct compare_sort_keys {
+        explicit compare_sort_keys(const StringTable& stringList) : stringList(stringList) {}
+
+        bool operator () (const sort_key& first, const sort_key& second) const {
+            if (first.bucket != second.bucket)
+                return first.bucket < second.bucket;
+            else if (first.prefix != second.prefix)
+                return first.prefix < second.prefix;
+            const int result = stringList.GetOldString(first.position).compare(stringList.GetOldString(second.position));
+            if (result != 0)
+                return result < 0;
             return first.id < second.id;
+        }
+
+        const StringTable& stringList;
+    };
+
+    static void SortKeys(sort_key * first, sort_key * last, const StringTable * stringList) {
+        sort(first, last, compare_sort_keys(*stringList));
+    }
+
+    static void MergeKeys(sort_key * first, sort_key * middle, sort_key * last, const StringTable * stringList) {
+        inplace_merge(first, middle, last, compare_sort_keys(*stringList));
+    }
+
+    void SortStrings(const StringTable& stringList, std::vector<uint32_t>& order) {
+        vector<sort_key> keys(stringList.size());
+        for (size_t i=0, max=keys.size(); i < max; ++i)
+            keys[i] = GetSortKey(stringList, i);
+
+        if (keys.size() < parallel_sort_threshold)
+            sort(keys.begin(), keys.end(), compare_sort_keys(stringList));
+        else {
+            //Each chunk is sorted on its own thread, then neighbouring runs
+            //are merged in pairs until only one is left.
+            WorkStealingPool pool;
+            const size_t chunkSize = (keys.size() + pool.size() - 1) / pool.size();
+            sort_key * const begin = &keys[0];
+            for (size_t i=0, max=keys.size(); i < max; i += chunkSize)
+                pool.Submit(boost::bind(SortKeys, begin + i, begin + min(i + chunkSize, max), &stringList));
+            pool.Wait();
+            for (size_t runSize=chunkSize, max=keys.size(); runSize < max; runSize *= 2) {
+                for (size_t i=0; i + runSize < max; i += 2 * runSize)
+                    pool.Submit(boost::bind(MergeKeys, begin + i, begin + i + runSize, begin + min(i + 2 * runSize, max), &stringList));
+                pool.Wait();
+            }
+        }
+
+        order.resize(keys.size());
+        for (size_t i=0, max=keys.size(); i < max; ++i)
+            order[i] = keys[i].position;
+    }
+
+    //Compares positions in a string list by one of its columns.
+    struct compare_column {
+        compare_column(const StringTable& stringList, const CollationKeys& keys, const sort_column column, const bool ascending)
+            : stringList(stringList), keys(keys), column(column), ascending(ascending) {}
+
+        bool operator () (const uint32_t first, const uint32_t second) const {
+            if (ascending)
+                return Less(first, second);
+            else
+                return Less(second, first);
+        }
+
+        bool Less(const uint32_t first, const uint32_t second) const {
+            if (column == sort_fuzzy)
+                return stringList.IsFuzzy(first) && !stringList.IsFuzzy(second);
+            else if (column == sort_id)
+                return stringList.GetId(first) < stringList.GetId(second);
+            else if (column == sort_old)
+                return keys.GetOldKey(first) < keys.GetOldKey(second);
+            else
+                return keys.GetNewKey(first) < keys.GetNewKey(second);
+        }
+
+        const StringTable& stringList;
+        const CollationKeys& keys;
+        sort_column column;
+        bool ascending;
+    };
+
+    void SortStrings(const StringTable& stringList,
+                     const sort_column column,
+                     const bool ascending,
+                           CollationKeys& keys,
+                           std::vector<uint32_t>& order) {
+        keys.Update(stringList, column);
+        stable_sort(order.begin(), order.end(), compare_column(stringList, keys, column, ascending));
     }
 }
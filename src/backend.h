@@ -25,61 +25,161 @@
 #define __STREDIT_BACKEND_H__
 
 #include <stdint.h>
+#include <deque>
 #include <string>
 #include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/unordered_map.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include "fuzzy.h"
+#include "levenshtein.h"
+#include "matchcache.h"
+#include "progress.h"
+#include "stringsfile.h"
+#include "stringtable.h"
+#include "threadpool.h"
 
 namespace stredit {
-    //Structure for holding string data.
-    struct str_data {
-        str_data() : fuzzy(false), id(0), edited(false) {}
+    //Statistics from a FuzzyMatchStrings() run. Identical strings are only
+    //matched once, so unique is the number of matches that were needed, and
+    //cached is how many of those were found in the match cache.
+    struct fuzzy_match_stats {
+        fuzzy_match_stats() : untranslated(0), unique(0), cached(0) {}
+
+        size_t untranslated;
+        size_t unique;
+        size_t cached;
+    };
 
-        bool fuzzy;  //For when using Levenstein matching.
-        uint32_t id;
-        std::string oldString;
+    //A string that FuzzyMatchStrings() has matched, and its position in the string list.
+    struct matched_string {
+        size_t position;
         std::string newString;
-        bool edited;
+        bool fuzzy;
+        std::vector<fuzzy_suggestion> suggestions;
+    };
+
+    //Collects copies of the strings that FuzzyMatchStrings() has finished matching, so that
+    //another thread can use their results while matching continues, without reading the
+    //string list that the matching threads are still writing to.
+    class MatchedStrings : private boost::noncopyable {
+    public:
+        void Add(const StringTable& stringList, const size_t * first, const size_t * last);
+
+        //Moves the strings added since the last call into strings.
+        void Take(std::vector<matched_string>& strings);
+    private:
+        boost::mutex mutex;
+        std::vector<matched_string> strings;
     };
 
     //Some global constants.
     const std::string readme_path = "StrEdit Readme.html";
     const std::string version_string = "0.4.0";
-
-    //String file reading/writing. These could be replaced by a more optimised
-    //per-string editing system once everything is working.
-    void GetStrings(const std::string path, const int fallbackEnc, boost::unordered_map<uint32_t, std::string>& stringMap);
-    void GetStrings(const std::string path, const int fallbackEnc, std::vector<str_data>& stringList);
-    void SetStrings(const std::string path, const std::vector<str_data>& stringList);
+    const size_t fuzzy_suggestion_count = 3;
+
+    //String file reading/writing. The strings read are copied into the
+    //table, so the file can be closed once they have been. Writing uses each
+    //string's new string, or its original string if it has none.
+    void GetStrings(const StringsFile& file, StringTable& stringList);
+
+    //Opens the files at paths concurrently on a pool of worker threads, using the fallback
+    //encodings at the same positions in fallbackEncs, and outputs them in the same order as
+    //paths. If any file can't be opened, the first error thrown is rethrown once the rest
+    //have finished, and files is left unchanged. Progress is advanced once per file opened.
+    void OpenStringsFiles(const std::vector<std::string>& paths,
+                          const std::vector<int>& fallbackEncs,
+                                boost::ptr_vector<StringsFile>& files,
+                          const CancelToken * cancel = NULL,
+                                ProgressState * progress = NULL);
+    void SetStrings(const std::string path, const StringTable& stringList, const CancelToken * cancel = NULL);
+
+    //Saves only the edited strings in stringList to the file at path, by appending them to its
+    //string data and pointing its directory at them. The file must hold stringList's IDs, with the
+    //same strings for all but the edited ones. Returns false without changing the file if the
+    //file doesn't hold the same IDs, or if strings that are no longer used would take up too much
+    //of it, in which case the file should be rewritten using SetStrings.
+    bool UpdateStrings(const std::string path, const StringTable& stringList, const CancelToken * cancel = NULL);
 
     //Import/Export strings as XML data.
-    void ImportAsXML(const std::string path,       std::vector<str_data>& stringList);
-    void ExportAsXML(const std::string path, const std::vector<str_data>& stringList);
+    void ImportAsXML(const std::string path,       StringTable& stringList, const CancelToken * cancel = NULL);
+    void ExportAsXML(const std::string path, const StringTable& stringList, const CancelToken * cancel = NULL);
 
-    //Matches the strings in the maps by their IDs. Any IDs which are not present in both maps
-    //are not included in the output. The passed vector has its contents appended to, not replaced.
-    void BuildStringPairs(const boost::unordered_map<uint32_t, std::string>& originalStrMap,
-                          const boost::unordered_map<uint32_t, std::string>& targetStrMap,
+    //Matches the strings in the files by their IDs. Any IDs which are not present in both files
+    //are not included in the output. The passed map has its contents appended to, not replaced.
+    void BuildStringPairs(const StringsFile& originalFile,
+                          const StringsFile& targetFile,
                                 boost::unordered_map<std::string, std::string>& stringMap);
 
-    //Matches the strings of map1 and map2 up using their IDs, and outputs the
-    //result. The lDist for all matches is 0, as only exact matching is used.
-    void BuildStringData(const boost::unordered_map<uint32_t, std::string>& originalStrMap,
-                         const boost::unordered_map<uint32_t, std::string>& targetStrMap,
-                               std::vector<str_data>& stringList);
-
-    //Fills in the empty newStrings in stringList by finding the closest Levenshtein match between
-    //their corresponding oldStrings and the keys of stringMap, then using the corresponding
-    //mapped string. It also updates the fuzzy data member as necessary.
-    void FuzzyMatchStrings(const boost::unordered_map<std::string, std::string>& stringMap,
-                                 std::vector<str_data>& stringList,
-                                 void * progDiaPtr);
-
-    //Some helper functions.
-    uint8_t * ToUint8_tString(const std::string str);
+    //Matches the strings of the files up using their IDs, and outputs the
+    //result.
+    void BuildStringData(const StringsFile& originalFile,
+                         const StringsFile& targetFile,
+                               StringTable& stringList);
+
+    //Fills in the empty new strings in stringList by finding the closest Levenshtein match between
+    //their corresponding original strings and the keys indexed by vocabIndex, then using the corresponding
+    //mapped string. It also updates the fuzzy flags as necessary. Each distinct original string
+    //is only matched once. Strings are matched on a pool of worker threads, which advance progress
+    //once per string matched, if it is given. If a cache is given, strings with a cached result aren't
+    //searched for, and the results of those that are get added to the cache. The suggestionCount
+    //closest matches are found in the same search and stored as suggestions for each string.
+    //If the cancel token is cancelled, the strings not yet matched are left as they are. If
+    //matched is given, strings are added to it as they are matched.
+    fuzzy_match_stats FuzzyMatchStrings(const FuzzyIndex& vocabIndex,
+                                              StringTable& stringList,
+                                              const size_t suggestionCount,
+                                              MatchCache * cache,
+                                              const CancelToken * cancel,
+                                              MatchedStrings * matched,
+                                              ProgressState * progress);
+
+    //The columns of the string list that strings can be sorted by.
+    enum sort_column {
+        sort_fuzzy,
+        sort_id,
+        sort_old,
+        sort_new
+    };
 
-    int Levenshtein(const std::string first, const std::string second);
+    //Caches collation keys for the strings in a string list, made by the global locale's
+    //collator. Comparing keys bytewise orders their strings as the locale does, so sorting
+    //by them doesn't need the locale. Keys are made the first time they are needed, and
+    //Invalidate() must be called for any string whose new string changes.
+    class CollationKeys {
+    public:
+        void Clear();
+        void Invalidate(const size_t position);
+
+        //Makes the keys for the strings in column that aren't cached. Large string lists
+        //have their keys made on a pool of worker threads.
+        void Update(const StringTable& stringList, const sort_column column);
+
+        const std::string& GetOldKey(const size_t position) const;
+        const std::string& GetNewKey(const size_t position) const;
+    private:
+        std::vector<std::string> oldKeys;
+        std::vector<std::string> newKeys;
+        std::vector<bool> newStale;
+    };
 
-    bool compare_old_new(const str_data first, const str_data second);
+    //Outputs the positions of the strings in stringList in sorted order,
+    //without moving them. Untranslated strings come first, followed by fuzzy
+    //matches, followed by all other strings. Within each group, strings are
+    //sorted by their original strings, then by their IDs.
+    void SortStrings(const StringTable& stringList, std::vector<uint32_t>& order);
+
+    //Sorts order, which holds positions of strings in stringList, by column, updating keys
+    //with any collation keys that are needed first. Strings that compare equal keep their
+    //order, so sorting by one column after another sorts by both.
+    void SortStrings(const StringTable& stringList,
+                     const sort_column column,
+                     const bool ascending,
+                           CollationKeys& keys,
+                           std::vector<uint32_t>& order);
 }
 
 #endif
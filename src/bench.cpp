@@ -0,0 +1,536 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "backend.h"
+#include "corpus.h"
+#include "searchindex.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <stdexcept>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/function.hpp>
+#include <boost/locale.hpp>
+
+using namespace std;
+using namespace stredit;
+
+//Every allocation made through new is counted, so that benchmarks can report
+//how many allocations their hot paths make. Each form of new has a matching
+//delete. GCC would otherwise inline the deletes and then warn that memory
+//from new is passed to free, which is only wrong outside these replacements.
+#ifdef __GNUC__
+#   define STREDIT_NOINLINE __attribute__((noinline))
+#else
+#   define STREDIT_NOINLINE
+#endif
+
+static boost::atomic<size_t> allocation_count(0);
+static boost::atomic<size_t> allocated_bytes(0);
+
+static void * CountedAlloc(const size_t size) throw() {
+    allocation_count.fetch_add(1, boost::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, boost::memory_order_relaxed);
+    return malloc(size == 0 ? 1 : size);
+}
+
+void * operator new(size_t size) throw(std::bad_alloc) {
+    void * ptr = CountedAlloc(size);
+    if (ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void * operator new[](size_t size) throw(std::bad_alloc) {
+    return operator new(size);
+}
+
+void * operator new(size_t size, const std::nothrow_t&) throw() {
+    return CountedAlloc(size);
+}
+
+void * operator new[](size_t size, const std::nothrow_t&) throw() {
+    return CountedAlloc(size);
+}
+
+STREDIT_NOINLINE void operator delete(void * ptr) throw() {
+    free(ptr);
+}
+
+STREDIT_NOINLINE void operator delete[](void * ptr) throw() {
+    free(ptr);
+}
+
+STREDIT_NOINLINE void operator delete(void * ptr, const std::nothrow_t&) throw() {
+    free(ptr);
+}
+
+STREDIT_NOINLINE void operator delete[](void * ptr, const std::nothrow_t&) throw() {
+    free(ptr);
+}
+
+//The options given on the command line.
+struct bench_options {
+    bench_options() : scale(1), repeat(5), tolerance(10), seed(1), duplicateRate(0.2f), nearDuplicateRate(0.1f) {}
+
+    size_t scale;
+    size_t repeat;
+    double tolerance;       //Percentage slowdown allowed before a baseline comparison fails.
+    uint32_t seed;
+    float duplicateRate;
+    float nearDuplicateRate;
+    string baselinePath;
+    string generateDir;
+    vector<string> names;   //Of the benchmarks to run, or empty to run them all.
+};
+
+//The fastest of a benchmark's runs. Allocations are per run.
+struct bench_result {
+    bench_result() : items(0), bytes(0), seconds(0), allocations(0), allocatedBytes(0) {}
+
+    string name;
+    size_t items;
+    size_t bytes;
+    double seconds;
+    size_t allocations;
+    size_t allocatedBytes;
+};
+
+//A corpus, held as a string list, and the files it has been saved as.
+struct bench_corpus {
+    vector<string> strings;
+    vector<string> translations;
+    StringTable list;
+    size_t bytes;
+    string path;
+    string transPath;
+};
+
+static void PrintUsage() {
+    cerr << "Usage: stredit-bench [options] [benchmark...]\n"
+            "\n"
+            "Measures the throughput and allocations of StrEdit's backend on generated\n"
+            "string tables, printing one line of JSON per benchmark. The output can be\n"
+            "saved and given back with --baseline to check for regressions.\n"
+            "\n"
+            "Benchmarks: levenshtein, fuzzy_match, get_strings, set_strings, import_xml,\n"
+            "            export_xml, search_index, filter, sort, collate, sort_column\n"
+            "\n"
+            "Options:\n"
+            "  --scale N          Multiply the corpus sizes by N. Default: 1.\n"
+            "  --repeat N         Run each benchmark N times, keeping the fastest. Default: 5.\n"
+            "  --seed N           Corpus generator seed. Default: 1.\n"
+            "  --duplicates F     Fraction of exactly duplicated strings. Default: 0.2.\n"
+            "  --near F           Fraction of nearly duplicated strings. Default: 0.1.\n"
+            "  --baseline FILE    Compare throughput with earlier output saved in FILE,\n"
+            "                     exiting with status 1 if any benchmark got slower.\n"
+            "  --tolerance PCT    Slowdown allowed by --baseline. Default: 10.\n"
+            "  --generate DIR     Write the corpora and their translations to DIR as\n"
+            "                     strings files, instead of running benchmarks.\n"
+            "  --help             Print this message.\n";
+}
+
+static bool ParseArguments(const int argc, char * argv[], bench_options& options) {
+    for (int i=1; i < argc; ++i) {
+        const string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--scale" && hasValue)
+            options.scale = max(atoi(argv[++i]), 1);
+        else if (arg == "--repeat" && hasValue)
+            options.repeat = max(atoi(argv[++i]), 1);
+        else if (arg == "--seed" && hasValue)
+            options.seed = strtoul(argv[++i], NULL, 10);
+        else if (arg == "--duplicates" && hasValue)
+            options.duplicateRate = atof(argv[++i]);
+        else if (arg == "--near" && hasValue)
+            options.nearDuplicateRate = atof(argv[++i]);
+        else if (arg == "--baseline" && hasValue)
+            options.baselinePath = argv[++i];
+        else if (arg == "--tolerance" && hasValue)
+            options.tolerance = atof(argv[++i]);
+        else if (arg == "--generate" && hasValue)
+            options.generateDir = argv[++i];
+        else if (arg.compare(0, 2, "--") == 0) {
+            cerr << "Invalid option: " << arg << endl;
+            return false;
+        } else
+            options.names.push_back(arg);
+    }
+    return true;
+}
+
+static void MakeCorpus(const bench_options& options, const corpus_kind kind, const size_t count, const string& path, bench_corpus& corpus) {
+    corpus_options corpusOptions;
+    corpusOptions.seed = options.seed + kind;
+    corpusOptions.count = count;
+    corpusOptions.kind = kind;
+    corpusOptions.duplicateRate = options.duplicateRate;
+    corpusOptions.nearDuplicateRate = options.nearDuplicateRate;
+    GenerateCorpus(corpusOptions, corpus.strings, corpus.translations);
+
+    corpus.bytes = 0;
+    corpus.list.Clear();
+    for (size_t i=0; i < count; ++i) {
+        corpus.list.Append(i + 1, corpus.strings[i]);
+        corpus.bytes += corpus.strings[i].length();
+    }
+
+    //The translation is saved alongside the corpus, for use as vocabulary.
+    corpus.path = path;
+    corpus.transPath = boost::filesystem::path(path).replace_extension().string() + "_translated" + boost::filesystem::path(path).extension().string();
+    SetStrings(corpus.path, corpus.list);
+    StringTable translated(corpus.list);
+    for (size_t i=0; i < count; ++i)
+        translated.SetNewString(i, corpus.translations[i]);
+    SetStrings(corpus.transPath, translated);
+}
+
+static bool IsSelected(const bench_options& options, const string& name) {
+    return options.names.empty() || find(options.names.begin(), options.names.end(), name) != options.names.end();
+}
+
+//Runs a benchmark, calling setup before each run without timing it.
+static bench_result RunBenchmark(const bench_options& options, const string& name, const size_t items, const size_t bytes,
+                                 const boost::function<void ()>& run,
+                                 const boost::function<void ()>& setup = boost::function<void ()>()) {
+    bench_result result;
+    result.name = name;
+    result.items = items;
+    result.bytes = bytes;
+    for (size_t i=0; i < options.repeat; ++i) {
+        if (setup)
+            setup();
+        const size_t allocations = allocation_count.load();
+        const size_t allocated = allocated_bytes.load();
+        const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+        run();
+        const double seconds = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1000000.0;
+        if (i == 0 || seconds < result.seconds)
+            result.seconds = seconds;
+        result.allocations = allocation_count.load() - allocations;
+        result.allocatedBytes = allocated_bytes.load() - allocated;
+    }
+    return result;
+}
+
+static double ItemsPerSecond(const bench_result& result) {
+    return result.seconds > 0 ? result.items / result.seconds : 0;
+}
+
+static void PrintResult(const bench_result& result) {
+    cout << "{\"name\":\"" << result.name << "\""
+         << ",\"items\":" << result.items
+         << ",\"bytes\":" << result.bytes
+         << ",\"ms\":" << result.seconds * 1000
+         << ",\"items_per_s\":" << ItemsPerSecond(result)
+         << ",\"mb_per_s\":" << (result.seconds > 0 ? result.bytes / result.seconds / 1048576 : 0)
+         << ",\"allocations\":" << result.allocations
+         << ",\"allocated_bytes\":" << result.allocatedBytes << "}" << endl;
+}
+
+//Benchmark bodies. They are bound to their data, so only the work being
+//measured happens inside them.
+static void LevenshteinRun(const vector<string> * strings, const size_t window, volatile int * checksum) {
+    LevenshteinPattern pattern;
+    vector<boost::string_ref> texts;
+    vector<int> dists;
+    for (size_t i=0, max=strings->size(); i + window < max; ++i) {
+        pattern.Assign((*strings)[i]);
+        texts.assign(strings->begin() + i + 1, strings->begin() + i + 1 + window);
+        dists.resize(window);
+        pattern.Distances(&texts[0], window, &dists[0]);
+        *checksum += dists[0];
+    }
+}
+
+static void ResetTranslations(const StringTable * original, StringTable * list) {
+    *list = *original;
+}
+
+static void FuzzyMatchRun(const FuzzyIndex * index, StringTable * list) {
+    FuzzyMatchStrings(*index, *list, fuzzy_suggestion_count, NULL, NULL, NULL, NULL);
+}
+
+static void GetStringsRun(const vector<string> * paths, StringTable * list) {
+    for (vector<string>::const_iterator it=paths->begin(), endIt=paths->end(); it != endIt; ++it) {
+        StringsFile file;
+        file.Open(*it, 1252);
+        GetStrings(file, *list);
+    }
+}
+
+static void ImportRun(const string * path, StringTable * list) {
+    ImportAsXML(*path, *list);
+}
+
+static void SearchIndexRun(const StringTable * list, SearchIndex * index) {
+    index->Build(*list);
+}
+
+static void FilterRun(const SearchIndex * index, const string * text, vector<int> * positions) {
+    index->Find(*text, search_old, *positions);
+}
+
+static void SortRun(const StringTable * list, vector<uint32_t> * order) {
+    SortStrings(*list, *order);
+}
+
+static void SortColumnRun(const StringTable * list, CollationKeys * keys, vector<uint32_t> * order) {
+    SortStrings(*list, sort_old, true, *keys, *order);
+}
+
+//Puts the strings back in their first order, and optionally discards their
+//collation keys so that they are made again.
+static void ResetOrder(const vector<uint32_t> * original, vector<uint32_t> * order, CollationKeys * keys) {
+    *order = *original;
+    if (keys != NULL)
+        keys->Clear();
+}
+
+//Reads the items_per_s of each benchmark from earlier output.
+static map<string, double> ReadBaseline(const string& path) {
+    boost::filesystem::ifstream in(path);
+    if (!in.good())
+        throw runtime_error("Could not read baseline file: " + path);
+
+    map<string, double> baseline;
+    string line;
+    while (getline(in, line)) {
+        const string nameKey = "\"name\":\"";
+        const string rateKey = "\"items_per_s\":";
+        const size_t namePos = line.find(nameKey);
+        const size_t ratePos = line.find(rateKey);
+        if (namePos == string::npos || ratePos == string::npos)
+            continue;
+        const size_t nameStart = namePos + nameKey.length();
+        const string name = line.substr(nameStart, line.find('"', nameStart) - nameStart);
+        baseline[name] = strtod(line.c_str() + ratePos + rateKey.length(), NULL);
+    }
+    return baseline;
+}
+
+//Returns false if any benchmark is slower than its baseline by more than
+//the tolerance. Benchmarks missing from the baseline are skipped.
+static bool CompareWithBaseline(const bench_options& options, const vector<bench_result>& results) {
+    const map<string, double> baseline = ReadBaseline(options.baselinePath);
+    bool passed = true;
+    for (vector<bench_result>::const_iterator it=results.begin(), endIt=results.end(); it != endIt; ++it) {
+        const map<string, double>::const_iterator baseIt = baseline.find(it->name);
+        if (baseIt == baseline.end() || baseIt->second <= 0)
+            continue;
+        const double change = (ItemsPerSecond(*it) / baseIt->second - 1) * 100;
+        const bool regressed = change < -options.tolerance;
+        cerr << left << setw(12) << it->name << right << setw(8) << showpos << change << noshowpos << "%"
+             << (regressed ? "  REGRESSION" : "") << endl;
+        if (regressed)
+            passed = false;
+    }
+    return passed;
+}
+
+int main(int argc, char * argv[]) {
+    //Set up locale stuff.
+    boost::locale::generator gen;
+    locale::global(gen(""));
+
+    if (argc > 1 && (string(argv[1]) == "--help" || string(argv[1]) == "-h")) {
+        PrintUsage();
+        return 0;
+    }
+    bench_options options;
+    if (!ParseArguments(argc, argv, options)) {
+        PrintUsage();
+        return 2;
+    }
+    cout << fixed << setprecision(3);
+    cerr << fixed << setprecision(1);
+
+    const bool generateOnly = !options.generateDir.empty();
+    const boost::filesystem::path dir = generateOnly
+        ? boost::filesystem::path(options.generateDir)
+        : boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("stredit-bench-%%%%-%%%%");
+    int status = 0;
+    try {
+        boost::filesystem::create_directories(dir);
+
+        bench_corpus names, dialogue, books;
+        MakeCorpus(options, corpus_names, 20000 * options.scale, (dir / "names.STRINGS").string(), names);
+        MakeCorpus(options, corpus_dialogue, 20000 * options.scale, (dir / "dialogue.ILSTRINGS").string(), dialogue);
+        MakeCorpus(options, corpus_books, 500 * options.scale, (dir / "books.DLSTRINGS").string(), books);
+        if (generateOnly)
+            return 0;
+
+        vector<bench_result> results;
+        volatile int checksum = 0;  //Keeps the distances from being optimised away.
+
+        if (IsSelected(options, "levenshtein")) {
+            const size_t window = 32;
+            size_t bytes = 0;
+            for (size_t i=0, max=dialogue.strings.size(); i + window < max; ++i)
+                bytes += dialogue.strings[i].length() * window;
+            results.push_back(RunBenchmark(options, "levenshtein", (dialogue.strings.size() - window) * window, bytes,
+                                           boost::bind(LevenshteinRun, &dialogue.strings, window, &checksum)));
+            PrintResult(results.back());
+        }
+
+        if (IsSelected(options, "fuzzy_match")) {
+            //The first half of the names and dialogue are the vocabulary,
+            //and some of the rest are matched against it.
+            boost::unordered_map<string, string> vocab;
+            for (size_t i=0, max=names.strings.size() / 2; i < max; ++i)
+                vocab.insert(pair<string, string>(names.strings[i], names.translations[i]));
+            for (size_t i=0, max=dialogue.strings.size() / 2; i < max; ++i)
+                vocab.insert(pair<string, string>(dialogue.strings[i], dialogue.translations[i]));
+            FuzzyIndex index;
+            index.Build(vocab);
+
+            StringTable original;
+            size_t bytes = 0;
+            for (size_t i=names.list.size() / 2, max=i + 500 * options.scale; i < max && i < names.list.size(); ++i)
+                original.Append(names.list.GetId(i), names.list.GetOldString(i));
+            for (size_t i=dialogue.list.size() / 2, max=i + 500 * options.scale; i < max && i < dialogue.list.size(); ++i)
+                original.Append(dialogue.list.GetId(i), dialogue.list.GetOldString(i));
+            for (size_t i=0, max=original.size(); i < max; ++i)
+                bytes += original.GetOldString(i).length();
+
+            StringTable list;
+            results.push_back(RunBenchmark(options, "fuzzy_match", original.size(), bytes,
+                                           boost::bind(FuzzyMatchRun, &index, &list),
+                                           boost::bind(ResetTranslations, &original, &list)));
+            PrintResult(results.back());
+        }
+
+        vector<string> paths;
+        paths.push_back(names.path);
+        paths.push_back(dialogue.path);
+        paths.push_back(books.path);
+        const size_t totalItems = names.list.size() + dialogue.list.size() + books.list.size();
+        const size_t totalBytes = names.bytes + dialogue.bytes + books.bytes;
+
+        if (IsSelected(options, "get_strings")) {
+            StringTable list;
+            results.push_back(RunBenchmark(options, "get_strings", totalItems, totalBytes,
+                                           boost::bind(GetStringsRun, &paths, &list)));
+            PrintResult(results.back());
+        }
+
+        if (IsSelected(options, "set_strings")) {
+            const string path = (dir / "output.DLSTRINGS").string();
+            results.push_back(RunBenchmark(options, "set_strings", dialogue.list.size(), dialogue.bytes,
+                                           boost::bind(SetStrings, path, boost::cref(dialogue.list), (const CancelToken *)NULL)));
+            PrintResult(results.back());
+        }
+
+        const string xmlPath = (dir / "dialogue.xml").string();
+        if (IsSelected(options, "export_xml") || IsSelected(options, "import_xml")) {
+            results.push_back(RunBenchmark(options, "export_xml", dialogue.list.size(), dialogue.bytes,
+                                           boost::bind(ExportAsXML, xmlPath, boost::cref(dialogue.list), (const CancelToken *)NULL)));
+            if (IsSelected(options, "export_xml"))
+                PrintResult(results.back());
+            else
+                results.pop_back();
+        }
+
+        if (IsSelected(options, "import_xml")) {
+            StringTable list;
+            results.push_back(RunBenchmark(options, "import_xml", dialogue.list.size(), dialogue.bytes,
+                                           boost::bind(ImportRun, &xmlPath, &list)));
+            PrintResult(results.back());
+        }
+
+        if (IsSelected(options, "search_index")) {
+            SearchIndex index;
+            results.push_back(RunBenchmark(options, "search_index", dialogue.list.size(), dialogue.bytes,
+                                           boost::bind(SearchIndexRun, &dialogue.list, &index)));
+            PrintResult(results.back());
+        }
+
+        if (IsSelected(options, "filter")) {
+            //A common syllable, so that plenty of strings match.
+            SearchIndex index;
+            index.Build(dialogue.list);
+            const string text = boost::locale::fold_case("Dor");
+            vector<int> positions;
+            results.push_back(RunBenchmark(options, "filter", dialogue.list.size(), dialogue.bytes,
+                                           boost::bind(FilterRun, &index, &text, &positions)));
+            PrintResult(results.back());
+        }
+
+        if (IsSelected(options, "sort")) {
+            //Mark some strings as translated and fuzzy, as after a machine
+            //translation, so that all the comparisons get used.
+            StringTable list(dialogue.list);
+            for (size_t i=0, max=list.size(); i < max; ++i) {
+                if (i % 3 != 0)
+                    list.SetNewString(i, dialogue.translations[i]);
+                list.SetFuzzy(i, i % 5 == 0);
+            }
+            vector<uint32_t> order;
+            results.push_back(RunBenchmark(options, "sort", list.size(), dialogue.bytes,
+                                           boost::bind(SortRun, &list, &order)));
+            PrintResult(results.back());
+        }
+
+        //Sorting by a column first makes the strings' collation keys, after
+        //which sorting by it again only compares them.
+        if (IsSelected(options, "collate") || IsSelected(options, "sort_column")) {
+            vector<uint32_t> original;
+            SortStrings(dialogue.list, original);
+            vector<uint32_t> order;
+            CollationKeys keys;
+            if (IsSelected(options, "collate")) {
+                results.push_back(RunBenchmark(options, "collate", dialogue.list.size(), dialogue.bytes,
+                                               boost::bind(SortColumnRun, &dialogue.list, &keys, &order),
+                                               boost::bind(ResetOrder, &original, &order, &keys)));
+                PrintResult(results.back());
+            }
+            if (IsSelected(options, "sort_column")) {
+                keys.Update(dialogue.list, sort_old);
+                results.push_back(RunBenchmark(options, "sort_column", dialogue.list.size(), dialogue.bytes,
+                                               boost::bind(SortColumnRun, &dialogue.list, &keys, &order),
+                                               boost::bind(ResetOrder, &original, &order, static_cast<CollationKeys *>(NULL))));
+                PrintResult(results.back());
+            }
+        }
+
+        if (!options.baselinePath.empty() && !CompareWithBaseline(options, results))
+            status = 1;
+    } catch (exception& e) {
+        cerr << e.what() << endl;
+        status = 2;
+    }
+
+    if (!generateOnly) {
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(dir, ec);
+    }
+    return status;
+}
@@ -0,0 +1,384 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "backend.h"
+#include "transmem.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/locale.hpp>
+
+using namespace std;
+using namespace stredit;
+
+//The options given on the command line.
+struct cli_options {
+    cli_options() : fallbackEnc(1252), approximate(false), jobs(0) {}
+
+    vector<vocab_pair> pairs;
+    string tmPath;
+    string transDir;   //Holds translations with the same filenames as the inputs.
+    string exportDir;
+    string saveDir;
+    int fallbackEnc;
+    bool approximate;
+    size_t jobs;       //Files processed at once, or zero for one per hardware thread.
+    vector<string> inputs;
+};
+
+//What happened to one input file, and how long each step took in milliseconds.
+struct file_result {
+    file_result() : ok(false), strings(0), openTime(0), translateTime(0), exportTime(0), saveTime(0) {}
+
+    string path;
+    bool ok;
+    string error;
+    size_t strings;
+    fuzzy_match_stats stats;
+    double openTime;
+    double translateTime;
+    double exportTime;
+    double saveTime;
+};
+
+static void PrintUsage() {
+    cerr << "Usage: stredit-cli [options] file...\n"
+            "\n"
+            "Opens each strings file, or imports each XML file, then optionally machine\n"
+            "translates, exports and saves it. Files are processed in parallel, sharing\n"
+            "the vocabulary. One line of JSON is printed for the vocabulary, each file and\n"
+            "the whole run, giving what was done and how long it took.\n"
+            "\n"
+            "Options:\n"
+            "  --vocab SOURCE TRANS  Add a pair of vocabulary files. Can be repeated.\n"
+            "  --tm PATH             Load the vocabulary from this translation memory file,\n"
+            "                        building and saving it if it is missing or outdated.\n"
+            "  --approximate         Use fast approximate matching.\n"
+            "  --translations DIR    Open the files of the same names in DIR as existing\n"
+            "                        translations of the inputs.\n"
+            "  --export-xml DIR      Export each file to DIR as XML.\n"
+            "  --save DIR            Save each file to DIR as a strings file.\n"
+            "  --encoding CODEPAGE   Fallback encoding for strings files. Default: 1252.\n"
+            "  --jobs N              Files to process at once. Default: one per CPU.\n"
+            "  --inputs FILE         Read more input paths from FILE, one per line.\n"
+            "  --help                Print this message.\n";
+}
+
+static double MillisecondsSince(const boost::posix_time::ptime start) {
+    return (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1000.0;
+}
+
+//Quotes a string for use in JSON output.
+static string JsonString(const string& str) {
+    ostringstream out;
+    out << '"';
+    for (string::const_iterator it=str.begin(), endIt=str.end(); it != endIt; ++it) {
+        if (*it == '"' || *it == '\\')
+            out << '\\' << *it;
+        else if (*it == '\n')
+            out << "\\n";
+        else if (*it == '\t')
+            out << "\\t";
+        else if (static_cast<unsigned char>(*it) < 0x20)
+            out << "\\u" << hex << setw(4) << setfill('0') << int(*it) << dec;
+        else
+            out << *it;
+    }
+    out << '"';
+    return out.str();
+}
+
+static bool IsXmlPath(const string& path) {
+    return boost::iequals(boost::filesystem::path(path).extension().string(), ".xml");
+}
+
+//Imported XML files are saved under their name without its .xml extension,
+//which is given a strings file extension if it doesn't already have one.
+static string GetStringsFilename(const string& path) {
+    boost::filesystem::path filename = boost::filesystem::path(path).filename();
+    if (!IsXmlPath(path))
+        return filename.string();
+
+    const string name = filename.stem().string();
+    if (!boost::iequals(boost::filesystem::path(name).extension().string(), ".STRINGS") && !HasLengthPrefixes(name))
+        return name + ".STRINGS";
+    return name;
+}
+
+//Returns false if the arguments are invalid.
+static bool ParseArguments(const int argc, char * argv[], cli_options& options) {
+    vector<pair<string, string> > pairPaths;
+    for (int i=1; i < argc; ++i) {
+        const string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--vocab" && i + 2 < argc) {
+            pairPaths.push_back(pair<string, string>(argv[i + 1], argv[i + 2]));
+            i += 2;
+        } else if (arg == "--tm" && hasValue)
+            options.tmPath = argv[++i];
+        else if (arg == "--approximate")
+            options.approximate = true;
+        else if (arg == "--translations" && hasValue)
+            options.transDir = argv[++i];
+        else if (arg == "--export-xml" && hasValue)
+            options.exportDir = argv[++i];
+        else if (arg == "--save" && hasValue)
+            options.saveDir = argv[++i];
+        else if (arg == "--encoding" && hasValue)
+            options.fallbackEnc = atoi(argv[++i]);
+        else if (arg == "--jobs" && hasValue)
+            options.jobs = atoi(argv[++i]);
+        else if (arg == "--inputs" && hasValue) {
+            boost::filesystem::ifstream in(argv[++i]);
+            if (!in.good()) {
+                cerr << "Could not read input list: " << argv[i] << endl;
+                return false;
+            }
+            string line;
+            while (getline(in, line)) {
+                boost::trim(line);
+                if (!line.empty())
+                    options.inputs.push_back(line);
+            }
+        } else if (boost::starts_with(arg, "--")) {
+            cerr << "Invalid option: " << arg << endl;
+            return false;
+        } else
+            options.inputs.push_back(arg);
+    }
+
+    for (vector<pair<string, string> >::const_iterator it=pairPaths.begin(), endIt=pairPaths.end(); it != endIt; ++it) {
+        vocab_pair vocabPair;
+        vocabPair.source = it->first;
+        vocabPair.trans = it->second;
+        vocabPair.sourceFallbackEnc = options.fallbackEnc;
+        vocabPair.transFallbackEnc = options.fallbackEnc;
+        options.pairs.push_back(vocabPair);
+    }
+
+    if (options.inputs.empty()) {
+        cerr << "No input files given." << endl;
+        return false;
+    }
+    if (!options.tmPath.empty() && options.pairs.empty()) {
+        cerr << "A translation memory file needs vocabulary files." << endl;
+        return false;
+    }
+    return true;
+}
+
+//Loads the vocabulary the same way as the GUI does, so that the two can share
+//translation memory files.
+static void LoadVocabulary(const cli_options& options, TranslationMemory& tm) {
+    const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    bool loaded = false;
+    if (!options.tmPath.empty() && boost::filesystem::exists(options.tmPath)) {
+        try {
+            tm.Load(options.tmPath);
+            loaded = tm.GetVocabPairs() == options.pairs && !tm.IsOutdated();
+        } catch (runtime_error& /*e*/) {
+            //Rebuild it.
+        }
+    }
+    string saveError;
+    if (!loaded) {
+        tm.Build(options.pairs, NULL);
+        if (!options.tmPath.empty()) {
+            try {
+                tm.Save(options.tmPath);
+            } catch (runtime_error& e) {
+                saveError = e.what();
+            }
+        }
+    }
+    if (options.approximate)
+        tm.GetIndex().SetSearchMode(FuzzyIndex::approximate_search);
+
+    cout << "{\"type\":\"vocabulary\",\"loaded\":" << (loaded ? "true" : "false")
+         << ",\"entries\":" << tm.GetIndex().size()
+         << ",\"ms\":" << MillisecondsSince(start);
+    if (!saveError.empty())
+        cout << ",\"error\":" << JsonString(saveError);
+    cout << "}" << endl;
+}
+
+static void PrintResult(const file_result& result) {
+    cout << "{\"type\":\"file\",\"path\":" << JsonString(result.path)
+         << ",\"ok\":" << (result.ok ? "true" : "false")
+         << ",\"strings\":" << result.strings
+         << ",\"untranslated\":" << result.stats.untranslated
+         << ",\"unique\":" << result.stats.unique
+         << ",\"cached\":" << result.stats.cached
+         << ",\"open_ms\":" << result.openTime
+         << ",\"translate_ms\":" << result.translateTime
+         << ",\"export_ms\":" << result.exportTime
+         << ",\"save_ms\":" << result.saveTime;
+    if (!result.ok)
+        cout << ",\"error\":" << JsonString(result.error);
+    cout << "}" << endl;
+}
+
+//Processes one input file, then prints its result. vocabIndex is NULL if
+//the files aren't being translated.
+static void ProcessFile(const cli_options * options, const FuzzyIndex * vocabIndex, MatchCache * cache, boost::mutex * outputMutex, file_result * result) {
+    try {
+        boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+        StringTable stringList;
+        if (IsXmlPath(result->path))
+            ImportAsXML(result->path, stringList);
+        else {
+            //The strings are copied into the table, so the files are closed
+            //once they have been read.
+            boost::ptr_vector<StringsFile> files;
+            vector<string> paths(1, result->path);
+            vector<int> fallbackEncs(1, options->fallbackEnc);
+            if (!options->transDir.empty()) {
+                const boost::filesystem::path transPath = boost::filesystem::path(options->transDir) / boost::filesystem::path(result->path).filename();
+                if (boost::filesystem::exists(transPath)) {
+                    paths.push_back(transPath.string());
+                    fallbackEncs.push_back(options->fallbackEnc);
+                }
+            }
+            OpenStringsFiles(paths, fallbackEncs, files);
+            if (files.size() == 1)
+                GetStrings(files[0], stringList);
+            else
+                BuildStringData(files[0], files[1], stringList);
+        }
+        result->strings = stringList.size();
+        result->openTime = MillisecondsSince(start);
+
+        if (vocabIndex != NULL) {
+            start = boost::posix_time::microsec_clock::universal_time();
+            result->stats = FuzzyMatchStrings(*vocabIndex, stringList, fuzzy_suggestion_count, cache, NULL, NULL, NULL);
+            result->translateTime = MillisecondsSince(start);
+        }
+
+        if (!options->exportDir.empty()) {
+            start = boost::posix_time::microsec_clock::universal_time();
+            const boost::filesystem::path xmlPath = boost::filesystem::path(options->exportDir) / (GetStringsFilename(result->path) + ".xml");
+            ExportAsXML(xmlPath.string(), stringList);
+            result->exportTime = MillisecondsSince(start);
+        }
+
+        if (!options->saveDir.empty()) {
+            start = boost::posix_time::microsec_clock::universal_time();
+            const boost::filesystem::path savePath = boost::filesystem::path(options->saveDir) / GetStringsFilename(result->path);
+            SetStrings(savePath.string(), stringList);
+            result->saveTime = MillisecondsSince(start);
+        }
+        result->ok = true;
+    } catch (exception& e) {  //bad_alloc or runtime_error.
+        result->error = e.what();
+    }
+
+    boost::lock_guard<boost::mutex> lock(*outputMutex);
+    PrintResult(*result);
+}
+
+int main(int argc, char * argv[]) {
+    //Set up locale stuff.
+    boost::locale::generator gen;
+    locale::global(gen(""));
+
+    if (argc > 1 && (string(argv[1]) == "--help" || string(argv[1]) == "-h")) {
+        PrintUsage();
+        return 0;
+    }
+    cli_options options;
+    if (!ParseArguments(argc, argv, options)) {
+        PrintUsage();
+        return 2;
+    }
+    cout << fixed << setprecision(3);
+    const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+    try {
+        if (!options.exportDir.empty())
+            boost::filesystem::create_directories(options.exportDir);
+        if (!options.saveDir.empty())
+            boost::filesystem::create_directories(options.saveDir);
+    } catch (boost::filesystem::filesystem_error& e) {
+        cerr << e.what() << endl;
+        return 2;
+    }
+
+    //The vocabulary is only loaded once, and all the files are matched
+    //against it. The match cache is shared by them too, so that strings
+    //which appear in several files are only matched once.
+    TranslationMemory tm;
+    MatchCache cache;
+    MatchCache * cachePtr = NULL;
+    if (!options.pairs.empty()) {
+        try {
+            LoadVocabulary(options, tm);
+        } catch (runtime_error& e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        if (!options.tmPath.empty()) {
+            try {
+                cache.Open(options.tmPath + ".cache", tm.GetIndex().GetFingerprint());
+                cachePtr = &cache;
+            } catch (runtime_error& /*e*/) {}
+        }
+    }
+    const FuzzyIndex * vocabIndex = options.pairs.empty() ? NULL : &tm.GetIndex();
+
+    vector<file_result> results(options.inputs.size());
+    boost::mutex outputMutex;
+    {
+        WorkStealingPool pool(options.jobs);
+        for (size_t i=0, max=options.inputs.size(); i < max; ++i) {
+            results[i].path = options.inputs[i];
+            pool.Submit(boost::bind(ProcessFile, &options, vocabIndex, cachePtr, &outputMutex, &results[i]));
+        }
+        pool.Wait();
+    }
+
+    if (cachePtr != NULL) {
+        try {
+            cache.Flush();
+        } catch (runtime_error& /*e*/) {}
+    }
+
+    size_t failed = 0;
+    for (vector<file_result>::const_iterator it=results.begin(), endIt=results.end(); it != endIt; ++it) {
+        if (!it->ok)
+            ++failed;
+    }
+    cout << "{\"type\":\"summary\",\"files\":" << results.size()
+         << ",\"failed\":" << failed
+         << ",\"ms\":" << MillisecondsSince(start) << "}" << endl;
+
+    return failed == 0 ? 0 : 1;
+}
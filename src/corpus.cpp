@@ -0,0 +1,168 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "corpus.h"
+
+#include <cctype>
+
+using namespace std;
+
+namespace stredit {
+    //A xorshift generator, used instead of rand() so that corpora don't
+    //depend on the platform's standard library.
+    struct corpus_random {
+        explicit corpus_random(const uint32_t seed) : state(seed == 0 ? 0x9E3779B9 : seed) {}
+
+        uint32_t Next() {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return state;
+        }
+
+        //Returns a number in [min, max].
+        size_t Range(const size_t min, const size_t max) {
+            return min + Next() % (max - min + 1);
+        }
+
+        //Returns a number in [0, 1).
+        double Fraction() {
+            return Next() / 4294967296.0;
+        }
+
+        uint32_t state;
+    };
+
+    static const char * const syllables[] = {
+        "ka", "dor", "el", "vin", "mar", "thu", "ra", "gol", "sta", "ren",
+        "bri", "ul", "fen", "dra", "mo", "sil", "vek", "an", "tor", "is",
+        "hal", "ge", "nir", "os", "wy", "lok", "ba", "rune", "sk", "yr"
+    };
+    static const size_t syllable_count = sizeof(syllables) / sizeof(syllables[0]);
+    static const size_t word_count = 2000;
+
+    //Letters are translated by swapping them with others, so that the
+    //translations have the same structure as the strings, but share little
+    //text with them.
+    static const char translated_letters[] = "eqwrtyuiopasdfghjklzxcvbnm";
+
+    static string Capitalise(string word) {
+        if (!word.empty())
+            word[0] = toupper(static_cast<unsigned char>(word[0]));
+        return word;
+    }
+
+    //Some words are much more common than others in real text, so the words
+    //are picked with a bias towards the start of the list.
+    static const string& PickWord(corpus_random& random, const vector<string>& words) {
+        const double r = random.Fraction();
+        return words[size_t(r * r * words.size())];
+    }
+
+    static string MakeSentence(corpus_random& random, const vector<string>& words, const size_t minWords, const size_t maxWords) {
+        string sentence = Capitalise(PickWord(random, words));
+        for (size_t i=1, max=random.Range(minWords, maxWords); i < max; ++i) {
+            sentence += (random.Next() % 12 == 0) ? ", " : " ";
+            sentence += PickWord(random, words);
+        }
+        const size_t end = random.Next() % 8;
+        sentence += (end == 0) ? '?' : ((end == 1) ? '!' : '.');
+        return sentence;
+    }
+
+    static string MakeString(corpus_random& random, const vector<string>& words, const corpus_kind kind) {
+        string str;
+        if (kind == corpus_names) {
+            for (size_t i=0, max=random.Range(1, 3); i < max; ++i) {
+                if (i > 0)
+                    str += (random.Next() % 5 == 0) ? " of " : " ";
+                str += Capitalise(PickWord(random, words));
+            }
+        } else if (kind == corpus_dialogue) {
+            for (size_t i=0, max=random.Range(1, 3); i < max; ++i) {
+                if (i > 0)
+                    str += ' ';
+                str += MakeSentence(random, words, 4, 18);
+            }
+        } else {
+            for (size_t i=0, max=random.Range(3, 12); i < max; ++i) {
+                if (i > 0)
+                    str += "\n\n";
+                for (size_t j=0, sentences=random.Range(3, 8); j < sentences; ++j) {
+                    if (j > 0)
+                        str += ' ';
+                    str += MakeSentence(random, words, 8, 25);
+                }
+            }
+        }
+        return str;
+    }
+
+    //Changes a few letters, as happens between versions of a string.
+    static string MakeNearDuplicate(corpus_random& random, string str) {
+        for (size_t i=0, max=random.Range(1, 3); i < max && !str.empty(); ++i) {
+            const size_t pos = random.Next() % str.length();
+            if (isalpha(static_cast<unsigned char>(str[pos])))
+                str[pos] = 'a' + random.Next() % 26;
+        }
+        return str;
+    }
+
+    static string Translate(string str) {
+        for (string::iterator it=str.begin(), endIt=str.end(); it != endIt; ++it) {
+            if (*it >= 'a' && *it <= 'z')
+                *it = translated_letters[*it - 'a'];
+            else if (*it >= 'A' && *it <= 'Z')
+                *it = toupper(translated_letters[*it - 'A']);
+        }
+        return str;
+    }
+
+    void GenerateCorpus(const corpus_options& options,
+                              std::vector<std::string>& strings,
+                              std::vector<std::string>& translations) {
+        corpus_random random(options.seed);
+        vector<string> words;
+        for (size_t i=0; i < word_count; ++i) {
+            string word;
+            for (size_t j=0, max=random.Range(1, 3); j < max; ++j)
+                word += syllables[random.Next() % syllable_count];
+            words.push_back(word);
+        }
+
+        strings.clear();
+        translations.clear();
+        strings.reserve(options.count);
+        translations.reserve(options.count);
+        for (size_t i=0; i < options.count; ++i) {
+            const double r = random.Fraction();
+            if (!strings.empty() && r < options.duplicateRate)
+                strings.push_back(strings[random.Next() % strings.size()]);
+            else if (!strings.empty() && r < options.duplicateRate + options.nearDuplicateRate)
+                strings.push_back(MakeNearDuplicate(random, strings[random.Next() % strings.size()]));
+            else
+                strings.push_back(MakeString(random, words, options.kind));
+            translations.push_back(Translate(strings.back()));
+        }
+    }
+}
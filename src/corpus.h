@@ -0,0 +1,59 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __STREDIT_CORPUS_H__
+#define __STREDIT_CORPUS_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace stredit {
+    //The kinds of string that Skyrim's string tables hold. STRINGS files
+    //mostly hold short names, ILSTRINGS files hold dialogue, and DLSTRINGS
+    //files hold descriptions and book text.
+    enum corpus_kind {
+        corpus_names,
+        corpus_dialogue,
+        corpus_books
+    };
+
+    struct corpus_options {
+        corpus_options() : seed(1), count(10000), kind(corpus_names), duplicateRate(0.2f), nearDuplicateRate(0.1f) {}
+
+        uint32_t seed;
+        size_t count;
+        corpus_kind kind;
+        float duplicateRate;      //Fraction of strings that repeat an earlier one exactly.
+        float nearDuplicateRate;  //Fraction that repeat an earlier one with a few edits.
+    };
+
+    //Generates count strings of the given kind, and a translation of each.
+    //The same options always generate the same strings on every platform,
+    //so results measured with them can be compared across builds.
+    void GenerateCorpus(const corpus_options& options,
+                              std::vector<std::string>& strings,
+                              std::vector<std::string>& translations);
+}
+
+#endif
@@ -0,0 +1,618 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "fuzzy.h"
+#include "levenshtein.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <boost/locale.hpp>
+#include <boost/thread/tss.hpp>
+
+using namespace std;
+using boost::locale::translate;
+
+namespace stredit {
+    static const size_t no_entry = size_t(-1);
+
+    //q-grams are hashed into 2^qgram_hash_bits posting lists. Hash collisions
+    //can only make keys look like they share more q-grams than they do, which
+    //keeps the distance bound valid.
+    static const size_t qgram_length = 3;
+    static const size_t qgram_hash_bits = 18;
+    static const size_t qgram_hash_count = size_t(1) << qgram_hash_bits;
+
+    //Exact searches only count shared q-grams for strings at least this long,
+    //as shorter strings are quicker to search without them.
+    static const size_t qgram_exact_min_length = 24;
+
+    //q-grams in more than this many keys are too common to be worth counting.
+    static const size_t qgram_max_postings = 256;
+
+    static uint32_t GramHash(const char * gram) {
+        const uint32_t bytes = static_cast<uint32_t>(static_cast<unsigned char>(gram[0]))
+                            | (static_cast<uint32_t>(static_cast<unsigned char>(gram[1])) << 8)
+                            | (static_cast<uint32_t>(static_cast<unsigned char>(gram[2])) << 16);
+        return (bytes * 2654435761u) >> (32 - qgram_hash_bits);
+    }
+
+    //Outputs the hashes of the q-grams in str, with the number of times each occurs.
+    static void GetGrams(const boost::string_ref str, vector< pair<uint32_t, uint32_t> >& grams) {
+        grams.clear();
+        for (size_t i=0; i + qgram_length <= str.length(); ++i)
+            grams.push_back(make_pair(GramHash(str.data() + i), 1u));
+        sort(grams.begin(), grams.end());
+
+        size_t last = 0;
+        for (size_t i=1; i < grams.size(); ++i) {
+            if (grams[i].first == grams[last].first)
+                ++grams[last].second;
+            else
+                grams[++last] = grams[i];
+        }
+        if (!grams.empty())
+            grams.resize(last + 1);
+    }
+
+    //Sorts indices into a list of strings by the strings they point to.
+    struct compare_indexed_strings {
+        compare_indexed_strings(const vector<const std::string *>& strings) : strings(strings) {}
+
+        bool operator () (const uint32_t first, const uint32_t second) const {
+            return *strings[first] < *strings[second];
+        }
+
+        const vector<const std::string *>& strings;
+    };
+
+    //A key that shares q-grams with the string being searched for. Sorts
+    //keys sharing the most q-grams first, then by rank.
+    struct gram_candidate {
+        bool operator < (const gram_candidate& other) const {
+            if (shared != other.shared)
+                return shared > other.shared;
+            return rank < other.rank;
+        }
+
+        uint32_t shared;
+        size_t rank;
+        uint32_t entry;
+    };
+
+    //A key whose distance has been calculated. Sorts closest first, then by rank.
+    struct scored_key {
+        bool operator < (const scored_key& other) const {
+            if (dist != other.dist)
+                return dist < other.dist;
+            return rank < other.rank;
+        }
+
+        int dist;
+        size_t rank;
+        size_t entry;
+    };
+
+    //Buffers that each thread reuses between searches.
+    struct search_buffers {
+        LevenshteinPattern pattern;
+        vector< pair<uint32_t, uint32_t> > grams;
+        vector<uint32_t> sharedGrams;   //Per entry. Only touched entries are non-zero.
+        vector<uint32_t> touched;       //Entries sharing at least one q-gram.
+        vector<gram_candidate> candidates;
+        vector<scored_key> closest;     //A heap with the furthest key at the front.
+    };
+
+    static boost::thread_specific_ptr<search_buffers> thread_buffers;
+
+    //The start of the memory block, which holds the counts needed to find the
+    //sections that follow it.
+    struct FuzzyIndex::block_header {
+        uint32_t entryCount;
+        uint32_t maxLength;
+        uint32_t postingCount;
+        uint32_t gramHashBits;
+        uint64_t textSize;
+        uint64_t fingerprint;   //Of the entries and text.
+    };
+
+    //The offsets of each section of a memory block, and its total size.
+    struct FuzzyIndex::block_layout {
+        uint64_t entries;
+        uint64_t histograms;
+        uint64_t bucketStarts;
+        uint64_t sortedKeys;
+        uint64_t gramStarts;
+        uint64_t postings;
+        uint64_t text;
+        uint64_t size;
+    };
+
+    static uint64_t AlignSection(const uint64_t offset) {
+        return (offset + 7) & ~uint64_t(7);
+    }
+
+    //The closest matches found so far by a search, and the keys waiting to
+    //have their distances calculated.
+    struct FuzzyIndex::search_state {
+        search_state(const boost::string_ref str, const size_t count, search_buffers& buffers) : str(str), count(count), buffers(buffers), closest(buffers.closest),
+                                                                                                 gramsCounted(false), uncountedGrams(0), batchSize(0) {
+            buffers.pattern.Assign(str);
+            BuildHistogram(str, histogram);
+            closest.clear();
+        }
+
+        //Leave the shared q-gram counts zeroed for the next search.
+        ~search_state() {
+            for (vector<uint32_t>::const_iterator it=buffers.touched.begin(), endIt=buffers.touched.end(); it != endIt; ++it)
+                buffers.sharedGrams[*it] = 0;
+            buffers.touched.clear();
+        }
+
+        //Keeps the key if it is one of the closest found so far. Keys can be
+        //scored more than once, but are only kept once.
+        void Add(const int dist, const size_t rank, const size_t entry) {
+            for (vector<scored_key>::const_iterator it=closest.begin(), endIt=closest.end(); it != endIt; ++it) {
+                if (it->entry == entry)
+                    return;
+            }
+
+            scored_key key;
+            key.dist = dist;
+            key.rank = rank;
+            key.entry = entry;
+            if (closest.size() < count) {
+                closest.push_back(key);
+                push_heap(closest.begin(), closest.end());
+            } else if (key < closest.front()) {
+                pop_heap(closest.begin(), closest.end());
+                closest.back() = key;
+                push_heap(closest.begin(), closest.end());
+            }
+        }
+
+        //The largest distance at which a key of the given rank would still be
+        //one of the closest found so far.
+        int Bound(const size_t rank) const {
+            if (closest.size() < count)
+                return INT_MAX;
+            return (rank < closest.front().rank) ? closest.front().dist : closest.front().dist - 1;
+        }
+
+        //The distance beyond which no key can be one of the closest.
+        int MaxDist() const {
+            return (closest.size() < count) ? INT_MAX : closest.front().dist;
+        }
+
+        //A lower bound on the distance to the key of entry i, using the q-gram
+        //lemma: each edit can destroy at most q of the q-grams they share.
+        int GramBound(const size_t i, const size_t keyLength) const {
+            if (!gramsCounted)
+                return 0;
+            const int unshared = static_cast<int>(max(str.length(), keyLength)) - static_cast<int>(qgram_length) + 1
+                               - static_cast<int>(buffers.sharedGrams[i] + uncountedGrams);
+            return (unshared > 0) ? (unshared + qgram_length - 1) / qgram_length : 0;
+        }
+
+        const boost::string_ref str;
+        const size_t count;
+        search_buffers& buffers;
+        vector<scored_key>& closest;
+        uint8_t histogram[histogram_bins];
+        bool gramsCounted;
+        uint32_t uncountedGrams;    //Too common to count, so assumed to be shared.
+
+        size_t batchSize;
+        size_t batch[LevenshteinPattern::max_lanes];
+        boost::string_ref batchKeys[LevenshteinPattern::max_lanes];
+        int batchBounds[LevenshteinPattern::max_lanes];
+    };
+
+    FuzzyIndex::FuzzyIndex() : mode(exact_search), candidateCount(32), block(NULL), blockSize(0), fingerprint(0), entryCount(0), maxLength(0),
+                               entries(NULL), histograms(NULL), bucketStarts(NULL), sortedKeys(NULL), gramStarts(NULL), postings(NULL), text(NULL) {}
+
+    void FuzzyIndex::Build(const boost::unordered_map<std::string, std::string>& map) {
+        block_header header;
+        header.entryCount = map.size();
+        header.maxLength = 0;
+        header.gramHashBits = qgram_hash_bits;
+        header.textSize = 0;
+        for (boost::unordered_map<std::string, std::string>::const_iterator it=map.begin(), endIt=map.end(); it != endIt; ++it) {
+            header.maxLength = max(header.maxLength, static_cast<uint32_t>(it->first.length()));
+            header.textSize += it->first.length() + it->second.length();
+        }
+        if (map.size() > numeric_limits<uint32_t>::max() || header.textSize > numeric_limits<uint32_t>::max())
+            throw runtime_error(translate("Vocabulary is too large to index."));
+
+        //Counting sort the keys by length. Keys are visited in iteration order,
+        //so each bucket ends up sorted by rank.
+        vector<uint32_t> buckets(header.maxLength + 2, 0);
+        for (boost::unordered_map<std::string, std::string>::const_iterator it=map.begin(), endIt=map.end(); it != endIt; ++it)
+            ++buckets[it->first.length() + 1];
+        for (size_t i=1; i < buckets.size(); ++i)
+            buckets[i] += buckets[i - 1];
+
+        vector<const std::string *> keys(map.size());
+        vector<const std::string *> values(map.size());
+        vector<uint32_t> ranks(map.size());
+        vector<uint32_t> next(buckets.begin(), buckets.end() - 1);
+        uint32_t rank = 0;
+        for (boost::unordered_map<std::string, std::string>::const_iterator it=map.begin(), endIt=map.end(); it != endIt; ++it) {
+            const size_t i = next[it->first.length()]++;
+            keys[i] = &it->first;
+            values[i] = &it->second;
+            ranks[i] = rank;
+            ++rank;
+        }
+
+        //Collect every entry's q-grams so that the posting lists' size is known.
+        vector< pair<uint32_t, posting> > allGrams;
+        vector< pair<uint32_t, uint32_t> > grams;
+        for (size_t i=0, max=keys.size(); i < max; ++i) {
+            GetGrams(*keys[i], grams);
+            for (vector< pair<uint32_t, uint32_t> >::const_iterator it=grams.begin(), endIt=grams.end(); it != endIt; ++it) {
+                posting p;
+                p.entry = i;
+                p.count = it->second;
+                allGrams.push_back(make_pair(it->first, p));
+            }
+        }
+        header.postingCount = allGrams.size();
+
+        //Now lay out the block and fill in its sections.
+        const block_layout layout = GetLayout(header);
+        vector<uint64_t> newStorage((layout.size + 7) / 8, 0);
+        char * out = reinterpret_cast<char *>(&newStorage[0]);
+        memcpy(out, &header, sizeof(block_header));
+
+        entry * outEntries = reinterpret_cast<entry *>(out + layout.entries);
+        char * outText = out + layout.text;
+        uint32_t offset = 0;
+        for (size_t i=0, max=keys.size(); i < max; ++i) {
+            outEntries[i].offset = offset;
+            outEntries[i].keyLength = keys[i]->length();
+            outEntries[i].valueLength = values[i]->length();
+            outEntries[i].rank = ranks[i];
+            BuildHistogram(*keys[i], reinterpret_cast<uint8_t *>(out + layout.histograms) + i * histogram_bins);
+
+            memcpy(outText + offset, keys[i]->data(), keys[i]->length());
+            offset += keys[i]->length();
+            memcpy(outText + offset, values[i]->data(), values[i]->length());
+            offset += values[i]->length();
+        }
+
+        copy(buckets.begin(), buckets.end(), reinterpret_cast<uint32_t *>(out + layout.bucketStarts));
+
+        uint32_t * outSortedKeys = reinterpret_cast<uint32_t *>(out + layout.sortedKeys);
+        for (size_t i=0, max=keys.size(); i < max; ++i)
+            outSortedKeys[i] = i;
+        sort(outSortedKeys, outSortedKeys + keys.size(), compare_indexed_strings(keys));
+
+        //Counting sort the q-grams into the posting lists.
+        uint32_t * outGramStarts = reinterpret_cast<uint32_t *>(out + layout.gramStarts);
+        for (vector< pair<uint32_t, posting> >::const_iterator it=allGrams.begin(), endIt=allGrams.end(); it != endIt; ++it)
+            ++outGramStarts[it->first + 1];
+        for (size_t i=1; i <= qgram_hash_count; ++i)
+            outGramStarts[i] += outGramStarts[i - 1];
+
+        posting * outPostings = reinterpret_cast<posting *>(out + layout.postings);
+        vector<uint32_t> nextPosting(outGramStarts, outGramStarts + qgram_hash_count);
+        for (vector< pair<uint32_t, posting> >::const_iterator it=allGrams.begin(), endIt=allGrams.end(); it != endIt; ++it)
+            outPostings[nextPosting[it->first]++] = it->second;
+
+        //Entries are hashed as well as the text, as their ranks and lengths
+        //affect search results.
+        block_header * outHeader = reinterpret_cast<block_header *>(out);
+        outHeader->fingerprint = StableHash(outText, header.textSize);
+        outHeader->fingerprint = StableHash(reinterpret_cast<const char *>(outEntries), header.entryCount * sizeof(entry), outHeader->fingerprint);
+
+        Attach(out, layout.size);
+        storage.swap(newStorage);
+    }
+
+    void FuzzyIndex::Write(std::ostream& out) const {
+        out.write(block, blockSize);
+    }
+
+    //Every offset and count in the block is checked, so that a damaged block
+    //can't cause reads outside of it.
+    void FuzzyIndex::Attach(const char * data, const size_t size) {
+        const runtime_error invalid(translate("Fuzzy match index is invalid."));
+
+        block_header header;
+        if (size < sizeof(block_header) || reinterpret_cast<uintptr_t>(data) % 8 != 0)
+            throw invalid;
+        memcpy(&header, data, sizeof(block_header));
+        if (header.gramHashBits != qgram_hash_bits)
+            throw invalid;
+        const block_layout layout = GetLayout(header);
+        if (layout.size != size)
+            throw invalid;
+
+        const entry * newEntries = reinterpret_cast<const entry *>(data + layout.entries);
+        const uint32_t * newBucketStarts = reinterpret_cast<const uint32_t *>(data + layout.bucketStarts);
+        const uint32_t * newSortedKeys = reinterpret_cast<const uint32_t *>(data + layout.sortedKeys);
+        const uint32_t * newGramStarts = reinterpret_cast<const uint32_t *>(data + layout.gramStarts);
+        const posting * newPostings = reinterpret_cast<const posting *>(data + layout.postings);
+
+        if (newBucketStarts[0] != 0 || newBucketStarts[header.maxLength + 1] != header.entryCount)
+            throw invalid;
+        for (size_t length=0; length <= header.maxLength; ++length) {
+            if (newBucketStarts[length] > newBucketStarts[length + 1])
+                throw invalid;
+            for (size_t i=newBucketStarts[length], endIndex=newBucketStarts[length + 1]; i < endIndex; ++i) {
+                const entry& e = newEntries[i];
+                if (e.keyLength != length || uint64_t(e.offset) + e.keyLength + e.valueLength > header.textSize)
+                    throw invalid;
+            }
+        }
+        for (size_t i=0; i < header.entryCount; ++i) {
+            if (newSortedKeys[i] >= header.entryCount)
+                throw invalid;
+        }
+        if (newGramStarts[0] != 0 || newGramStarts[qgram_hash_count] != header.postingCount)
+            throw invalid;
+        for (size_t i=0; i < qgram_hash_count; ++i) {
+            if (newGramStarts[i] > newGramStarts[i + 1])
+                throw invalid;
+        }
+        for (size_t i=0; i < header.postingCount; ++i) {
+            if (newPostings[i].entry >= header.entryCount)
+                throw invalid;
+        }
+
+        block = data;
+        blockSize = size;
+        fingerprint = header.fingerprint;
+        entryCount = header.entryCount;
+        maxLength = header.maxLength;
+        entries = newEntries;
+        histograms = reinterpret_cast<const uint8_t *>(data + layout.histograms);
+        bucketStarts = newBucketStarts;
+        sortedKeys = newSortedKeys;
+        gramStarts = newGramStarts;
+        postings = newPostings;
+        text = data + layout.text;
+
+        //Any block from an earlier Build() is no longer needed.
+        vector<uint64_t>().swap(storage);
+    }
+
+    void FuzzyIndex::SetSearchMode(const search_mode newMode, const size_t newCandidateCount) {
+        mode = newMode;
+        candidateCount = newCandidateCount;
+    }
+
+    bool FuzzyIndex::FindBestMatch(const boost::string_ref str, size_t& entry, int& dist) const {
+        fuzzy_match match;
+        if (FindBestMatches(str, 1, &match) == 0)
+            return false;
+
+        entry = match.entry;
+        dist = match.dist;
+        return true;
+    }
+
+    //The closest keys are kept in a bounded heap, so finding several adds
+    //little to the cost of finding one, other than the looser bounds.
+    size_t FuzzyIndex::FindBestMatches(const boost::string_ref str, const size_t count, fuzzy_match * matches) const {
+        if (entryCount == 0 || count == 0)
+            return 0;
+
+        const size_t exact = FindKey(str);
+        if (exact != no_entry && count == 1) {
+            matches[0].entry = exact;
+            matches[0].dist = 0;
+            return 1;
+        }
+
+        search_buffers * buffers = thread_buffers.get();
+        if (buffers == NULL) {
+            buffers = new search_buffers();
+            thread_buffers.reset(buffers);
+        }
+        if (buffers->sharedGrams.size() < entryCount)
+            buffers->sharedGrams.resize(entryCount, 0);
+
+        search_state state(str, count, *buffers);
+        if (exact != no_entry)
+            state.Add(0, entries[exact].rank, exact);
+
+        //Score the keys sharing the most q-grams first, to get close matches
+        //early on. Approximate searches stop there, unless str shares no
+        //q-grams with any key.
+        if (mode == approximate_search || str.length() >= qgram_exact_min_length) {
+            CountSharedGrams(state);
+            SearchCandidates(state);
+        }
+
+        //The length difference is a lower bound on the distance, so search
+        //outwards from the buckets closest in length to str, stopping once the
+        //difference is greater than the distance of the furthest match kept.
+        if (mode == exact_search || state.closest.empty()) {
+            const size_t length = str.length();
+            for (size_t lengthDiff=0; static_cast<int>(lengthDiff) <= state.MaxDist(); ++lengthDiff) {
+                if (lengthDiff > length && length + lengthDiff > maxLength)
+                    break;  //There are no buckets left on either side.
+
+                if (lengthDiff <= length && length - lengthDiff <= maxLength)
+                    SearchBucket(state, length - lengthDiff, lengthDiff);
+                if (lengthDiff > 0 && length + lengthDiff <= maxLength)
+                    SearchBucket(state, length + lengthDiff, lengthDiff);
+            }
+        }
+
+        sort_heap(state.closest.begin(), state.closest.end());
+        for (size_t i=0, max=state.closest.size(); i < max; ++i) {
+            matches[i].entry = state.closest[i].entry;
+            matches[i].dist = state.closest[i].dist;
+        }
+        return state.closest.size();
+    }
+
+    boost::string_ref FuzzyIndex::GetKey(const size_t i) const {
+        return boost::string_ref(text + entries[i].offset, entries[i].keyLength);
+    }
+
+    boost::string_ref FuzzyIndex::GetValue(const size_t i) const {
+        return boost::string_ref(text + entries[i].offset + entries[i].keyLength, entries[i].valueLength);
+    }
+
+    uint64_t FuzzyIndex::GetFingerprint() const {
+        const uint64_t settings[2] = { mode, candidateCount };
+        return StableHash(reinterpret_cast<const char *>(settings), sizeof(settings), fingerprint);
+    }
+
+    size_t FuzzyIndex::size() const {
+        return entryCount;
+    }
+
+    FuzzyIndex::block_layout FuzzyIndex::GetLayout(const block_header& header) {
+        block_layout layout;
+        layout.entries = AlignSection(sizeof(block_header));
+        layout.histograms = AlignSection(layout.entries + uint64_t(header.entryCount) * sizeof(entry));
+        layout.bucketStarts = AlignSection(layout.histograms + uint64_t(header.entryCount) * histogram_bins);
+        layout.sortedKeys = AlignSection(layout.bucketStarts + (uint64_t(header.maxLength) + 2) * sizeof(uint32_t));
+        layout.gramStarts = AlignSection(layout.sortedKeys + uint64_t(header.entryCount) * sizeof(uint32_t));
+        layout.postings = AlignSection(layout.gramStarts + (uint64_t(qgram_hash_count) + 1) * sizeof(uint32_t));
+        layout.text = layout.postings + uint64_t(header.postingCount) * sizeof(posting);
+        layout.size = layout.text + header.textSize;
+        return layout;
+    }
+
+    //Binary searches the keys, returning the matching entry or no_entry.
+    size_t FuzzyIndex::FindKey(const boost::string_ref str) const {
+        size_t first = 0;
+        size_t count = entryCount;
+        while (count > 0) {
+            const size_t step = count / 2;
+            if (GetKey(sortedKeys[first + step]) < str) {
+                first += step + 1;
+                count -= step + 1;
+            } else
+                count = step;
+        }
+
+        if (first < entryCount && GetKey(sortedKeys[first]) == str)
+            return sortedKeys[first];
+        return no_entry;
+    }
+
+    void FuzzyIndex::CountSharedGrams(search_state& state) const {
+        search_buffers& buffers = state.buffers;
+        GetGrams(state.str, buffers.grams);
+        for (vector< pair<uint32_t, uint32_t> >::const_iterator it=buffers.grams.begin(), endIt=buffers.grams.end(); it != endIt; ++it) {
+            if (gramStarts[it->first + 1] - gramStarts[it->first] > qgram_max_postings) {
+                state.uncountedGrams += it->second;
+                continue;
+            }
+            for (size_t i=gramStarts[it->first], endIndex=gramStarts[it->first + 1]; i < endIndex; ++i) {
+                const posting& p = postings[i];
+                uint32_t& shared = buffers.sharedGrams[p.entry];
+                if (shared == 0)
+                    buffers.touched.push_back(p.entry);
+                shared += min(it->second, p.count);
+            }
+        }
+        state.gramsCounted = true;
+    }
+
+    void FuzzyIndex::SearchCandidates(search_state& state) const {
+        vector<gram_candidate>& candidates = state.buffers.candidates;
+        candidates.clear();
+        for (vector<uint32_t>::const_iterator it=state.buffers.touched.begin(), endIt=state.buffers.touched.end(); it != endIt; ++it) {
+            gram_candidate c;
+            c.shared = state.buffers.sharedGrams[*it];
+            c.rank = entries[*it].rank;
+            c.entry = *it;
+            candidates.push_back(c);
+        }
+
+        const size_t count = min(candidateCount, candidates.size());
+        partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+
+        for (size_t i=0; i < count; ++i) {
+            const size_t keyLength = entries[candidates[i].entry].keyLength;
+            const size_t lengthDiff = max(keyLength, state.str.length()) - min(keyLength, state.str.length());
+            AddToBatch(state, candidates[i].entry, lengthDiff);
+        }
+        ScoreBatch(state);
+    }
+
+    void FuzzyIndex::SearchBucket(search_state& state, const size_t length, const int lengthDiff) const {
+        for (size_t i=bucketStarts[length], endIndex=bucketStarts[length + 1]; i < endIndex; ++i) {
+            if (lengthDiff > state.Bound(entries[i].rank))
+                break;  //Later keys are higher ranked, so have the same bound.
+            AddToBatch(state, i, lengthDiff);
+        }
+        ScoreBatch(state);
+    }
+
+    //Keys that can't be one of the closest according to their length, shared
+    //q-grams or histogram are skipped, and the rest are scored in batches so
+    //that the distance kernel can use SIMD lanes.
+    void FuzzyIndex::AddToBatch(search_state& state, const size_t i, const int lengthDiff) const {
+        const int bound = state.Bound(entries[i].rank);
+        if (lengthDiff > bound
+            || state.GramBound(i, entries[i].keyLength) > bound
+            || HistogramDistance(state.histogram, &histograms[i * histogram_bins]) > bound)
+            return;
+
+        state.batch[state.batchSize] = i;
+        state.batchKeys[state.batchSize] = GetKey(i);
+        state.batchBounds[state.batchSize] = bound;
+        ++state.batchSize;
+        if (state.batchSize == LevenshteinPattern::lanes)
+            ScoreBatch(state);
+    }
+
+    //Each key's distance is only calculated up to the bound at which it could
+    //still be one of the closest when it was added to the batch.
+    void FuzzyIndex::ScoreBatch(search_state& state) const {
+        if (state.batchSize == 0)
+            return;
+
+        int batchBound = 0;
+        for (size_t i=0; i < state.batchSize; ++i)
+            batchBound = max(batchBound, state.batchBounds[i]);
+
+        int dists[LevenshteinPattern::max_lanes];
+        state.buffers.pattern.Distances(state.batchKeys, state.batchSize, dists, batchBound);
+
+        for (size_t i=0; i < state.batchSize; ++i) {
+            if (dists[i] <= state.batchBounds[i])
+                state.Add(dists[i], entries[state.batch[i]].rank, state.batch[i]);
+        }
+        state.batchSize = 0;
+    }
+
+    uint64_t StableHash(const char * data, const size_t length, const uint64_t seed) {
+        uint64_t hash = seed;
+        for (size_t i=0; i < length; ++i) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+}
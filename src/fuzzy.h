@@ -0,0 +1,159 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __STREDIT_FUZZY_H__
+#define __STREDIT_FUZZY_H__
+
+#include <stdint.h>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include "levenshtein.h"
+
+namespace stredit {
+    //A key found by a FuzzyIndex search, and its distance from the string.
+    struct fuzzy_match {
+        size_t entry;
+        int dist;
+    };
+
+    //An index of the keys of a vocabulary map, for finding the closest
+    //Levenshtein match for a string. Keys are bucketed by length and given a
+    //byte histogram, so that most can be ruled out using cheap lower bounds
+    //on their distance, and whole buckets can be skipped once their length
+    //differs from the string's by more than the best distance found so far.
+    //
+    //An inverted index of the keys' q-grams (substrings of q bytes) is also
+    //kept. Keys sharing the most q-grams with a long string are scored first
+    //to get a close match early, and the number of q-grams shared gives
+    //another lower bound on the distance of the rest.
+    //
+    //The index and the strings it maps are stored in a single block of memory
+    //that contains no pointers, so that it can be written to a file and used
+    //directly from a memory-mapped view of that file.
+    class FuzzyIndex : private boost::noncopyable {
+    public:
+        //Exact searches always find the closest key. Approximate searches only
+        //score the keys that share the most q-grams with the string, so may
+        //miss the closest key but are much faster for long strings.
+        enum search_mode {
+            exact_search,
+            approximate_search
+        };
+
+        FuzzyIndex();
+
+        //Copies the keys and mapped strings of stringMap into the index.
+        void Build(const boost::unordered_map<std::string, std::string>& stringMap);
+
+        //Writes the index's memory block to out, and uses a block that was
+        //written earlier. Attach() doesn't copy the block, so it must outlive
+        //the index, and throws if it isn't a valid index.
+        void Write(std::ostream& out) const;
+        void Attach(const char * data, const size_t size);
+
+        //candidateCount is the number of keys scored first by exact searches,
+        //and the only keys scored by approximate searches.
+        void SetSearchMode(const search_mode mode, const size_t candidateCount = 32);
+
+        //Finds the key closest to str and outputs its entry and distance.
+        //Equally close keys are resolved in favour of the one that came first
+        //in the iteration order of the map the index was built from, which
+        //gives the same result as scanning the map. Returns false if the index
+        //is empty. Safe to call from several threads at once.
+        bool FindBestMatch(const boost::string_ref str, size_t& entry, int& dist) const;
+
+        //Finds the count keys closest to str in the same way, and outputs them
+        //to matches closest first. Returns the number of keys found, which is
+        //only less than count if the index has fewer keys.
+        size_t FindBestMatches(const boost::string_ref str, const size_t count, fuzzy_match * matches) const;
+
+        boost::string_ref GetKey(const size_t entry) const;
+        boost::string_ref GetValue(const size_t entry) const;
+
+        //Identifies the indexed strings and the search mode, so that search
+        //results can be stored and reused while both are unchanged.
+        uint64_t GetFingerprint() const;
+
+        size_t size() const;
+    private:
+        struct entry {
+            uint32_t offset;        //Of the key in the text, followed by its mapped string.
+            uint32_t keyLength;
+            uint32_t valueLength;
+            uint32_t rank;          //Position in the map's iteration order.
+        };
+
+        //An entry containing a q-gram, and how many times it does so.
+        struct posting {
+            uint32_t entry;
+            uint32_t count;
+        };
+
+        struct block_header;
+        struct block_layout;
+        struct search_state;
+
+        static block_layout GetLayout(const block_header& header);
+
+        size_t FindKey(const boost::string_ref str) const;
+
+        void CountSharedGrams(search_state& state) const;
+        void SearchCandidates(search_state& state) const;
+        void SearchBucket(search_state& state, const size_t length, const int lengthDiff) const;
+        void AddToBatch(search_state& state, const size_t i, const int lengthDiff) const;
+        void ScoreBatch(search_state& state) const;
+
+        search_mode mode;
+        size_t candidateCount;
+
+        //Built indices keep their memory block here. Its elements are 64-bit
+        //so that every section of the block is suitably aligned.
+        std::vector<uint64_t> storage;
+        const char * block;
+        size_t blockSize;
+
+        //Sections of the block.
+        uint64_t fingerprint;
+        size_t entryCount;
+        size_t maxLength;
+        const entry * entries;          //Sorted by key length, then by rank.
+        const uint8_t * histograms;     //histogram_bins per entry, in the same order.
+        const uint32_t * bucketStarts;  //The first entry of each key length, indexed by length.
+        const uint32_t * sortedKeys;    //Entries sorted by key, for exact lookups.
+        const uint32_t * gramStarts;    //The first posting of each q-gram hash, indexed by hash.
+        const posting * postings;       //Sorted by q-gram hash, then by entry.
+        const char * text;
+    };
+
+    //A 64-bit FNV-1a hash. Unlike boost::hash, it gives the same value on
+    //every platform and Boost version, so can be stored in files.
+    const uint64_t stable_hash_seed = 14695981039346656037ULL;
+    uint64_t StableHash(const char * data, const size_t length, const uint64_t seed = stable_hash_seed);
+}
+
+#endif
@@ -0,0 +1,417 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "levenshtein.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__AVX2__)
+#   include <immintrin.h>
+#   define STREDIT_LEVENSHTEIN_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define STREDIT_LEVENSHTEIN_SSE2
+#endif
+
+using namespace std;
+
+namespace stredit {
+    //How many text characters are processed between checks of whether a
+    //bounded distance can still come in under its bound.
+    static const size_t bound_check_interval = 8;
+
+    //Returns a lower bound on the final distance, given the distances in rows
+    //top and bottom of the current column. A row can't be more than one less
+    //than the row above or below it, and getting from row i to the end costs
+    //at least |diagonal - i|. The bound is a convex piecewise linear function
+    //of the row, so its minimum is at a corner or at one end of the range.
+    static int RowRangeBound(const int top, const int topScore, const int bottom, const int bottomScore, const int diagonal) {
+        const int crossing = (topScore + top - bottomScore + bottom) / 2;
+        const int rows[5] = { top, bottom, diagonal, crossing, crossing + 1 };
+        int least = INT_MAX;
+        for (size_t i=0; i < 5; ++i) {
+            const int row = min(max(rows[i], top), bottom);
+            const int bound = max(topScore - (row - top), bottomScore - (bottom - row)) + abs(diagonal - row);
+            least = min(least, bound);
+        }
+        return least;
+    }
+
+    //Myers' algorithm for a pattern that fits in a single word. peq holds the
+    //bitmask of positions in the pattern at which each byte value occurs.
+    static int WordDistance(const uint64_t * peq, const size_t patternLength, const boost::string_ref text, const int maxDist) {
+        const int m = patternLength;
+        const int n = text.length();
+        const bool bounded = maxDist < m + n;
+        if (bounded && abs(m - n) > maxDist)
+            return maxDist + 1;
+
+        const char * data = text.data();
+        const uint64_t lastBit = uint64_t(1) << (m - 1);
+        uint64_t pv = ~uint64_t(0);
+        uint64_t mv = 0;
+        int score = m;
+        for (int j=0; j < n; ++j) {
+            const uint64_t eq = peq[static_cast<unsigned char>(data[j])];
+            const uint64_t xv = eq | mv;
+            const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            uint64_t ph = mv | ~(xh | pv);
+            uint64_t mh = pv & xh;
+            if (ph & lastBit)
+                ++score;
+            else if (mh & lastBit)
+                --score;
+            ph = (ph << 1) | 1;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+
+            if (bounded && (j + 1) % bound_check_interval == 0
+                && RowRangeBound(0, j + 1, m, score, m - n + j + 1) > maxDist)
+                return maxDist + 1;
+        }
+
+        if (bounded && score > maxDist)
+            return maxDist + 1;
+        return score;
+    }
+
+#if defined(STREDIT_LEVENSHTEIN_AVX2)
+    const size_t LevenshteinPattern::lanes = 4;
+#elif defined(STREDIT_LEVENSHTEIN_SSE2)
+    const size_t LevenshteinPattern::lanes = 2;
+#else
+    const size_t LevenshteinPattern::lanes = 1;
+#endif
+
+#if defined(STREDIT_LEVENSHTEIN_AVX2) || defined(STREDIT_LEVENSHTEIN_SSE2)
+    //Checks whether any lane of a bounded WordDistances() call can still come
+    //in under the bound, after processing `processed` text characters.
+    static bool AnyLaneInBound(const uint64_t * scores, const int * lengths, const size_t laneCount,
+                               const int patternLength, const int processed, const int maxDist) {
+        for (size_t l=0; l < laneCount; ++l) {
+            const int score = static_cast<int>(scores[l]);
+            if (processed >= lengths[l]) {
+                if (score <= maxDist)
+                    return true;
+            } else if (RowRangeBound(0, processed, patternLength, score, patternLength - lengths[l] + processed) <= maxDist)
+                return true;
+        }
+        return false;
+    }
+#endif
+
+#if defined(STREDIT_LEVENSHTEIN_AVX2)
+    //WordDistance() for four texts at once, one per 64-bit lane.
+    static void WordDistances(const uint64_t * peq, const size_t patternLength, const boost::string_ref * texts, int * dists, const int maxDist) {
+        const int lengths[4] = { static_cast<int>(texts[0].length()), static_cast<int>(texts[1].length()),
+                                 static_cast<int>(texts[2].length()), static_cast<int>(texts[3].length()) };
+        const int maxLength = max(max(lengths[0], lengths[1]), max(lengths[2], lengths[3]));
+        const bool bounded = maxDist < static_cast<int>(patternLength) + maxLength;
+        const __m256i ones = _mm256_set1_epi64x(-1);
+        const __m256i one = _mm256_set1_epi64x(1);
+        const __m128i lastShift = _mm_cvtsi32_si128(patternLength - 1);
+
+        __m256i pv = ones;
+        __m256i mv = _mm256_setzero_si256();
+        __m256i score = _mm256_set1_epi64x(patternLength);
+        uint64_t eqs[4];
+        uint64_t active[4];
+        uint64_t scores[4];
+        for (int j=0; j < maxLength; ++j) {
+            for (size_t l=0; l < 4; ++l) {
+                if (j < lengths[l]) {
+                    eqs[l] = peq[static_cast<unsigned char>(texts[l][j])];
+                    active[l] = ~uint64_t(0);
+                } else {
+                    eqs[l] = 0;
+                    active[l] = 0;
+                }
+            }
+            const __m256i eq = _mm256_set_epi64x(eqs[3], eqs[2], eqs[1], eqs[0]);
+            const __m256i isActive = _mm256_set_epi64x(active[3], active[2], active[1], active[0]);
+
+            const __m256i xv = _mm256_or_si256(eq, mv);
+            const __m256i xh = _mm256_or_si256(_mm256_xor_si256(_mm256_add_epi64(_mm256_and_si256(eq, pv), pv), pv), eq);
+            __m256i ph = _mm256_or_si256(mv, _mm256_andnot_si256(_mm256_or_si256(xh, pv), ones));
+            __m256i mh = _mm256_and_si256(pv, xh);
+
+            const __m256i delta = _mm256_sub_epi64(_mm256_and_si256(_mm256_srl_epi64(ph, lastShift), one),
+                                                   _mm256_and_si256(_mm256_srl_epi64(mh, lastShift), one));
+            score = _mm256_add_epi64(score, _mm256_and_si256(delta, isActive));
+
+            ph = _mm256_or_si256(_mm256_slli_epi64(ph, 1), one);
+            mh = _mm256_slli_epi64(mh, 1);
+            pv = _mm256_or_si256(mh, _mm256_andnot_si256(_mm256_or_si256(xv, ph), ones));
+            mv = _mm256_and_si256(ph, xv);
+
+            if (bounded && (j + 1) % bound_check_interval == 0) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(scores), score);
+                if (!AnyLaneInBound(scores, lengths, 4, patternLength, j + 1, maxDist)) {
+                    for (size_t l=0; l < 4; ++l)
+                        dists[l] = maxDist + 1;
+                    return;
+                }
+            }
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(scores), score);
+        for (size_t l=0; l < 4; ++l)
+            dists[l] = min(static_cast<int>(scores[l]), bounded ? maxDist + 1 : INT_MAX);
+    }
+#elif defined(STREDIT_LEVENSHTEIN_SSE2)
+    //WordDistance() for two texts at once, one per 64-bit lane.
+    static void WordDistances(const uint64_t * peq, const size_t patternLength, const boost::string_ref * texts, int * dists, const int maxDist) {
+        const int lengths[2] = { static_cast<int>(texts[0].length()), static_cast<int>(texts[1].length()) };
+        const int maxLength = max(lengths[0], lengths[1]);
+        const bool bounded = maxDist < static_cast<int>(patternLength) + maxLength;
+        const __m128i ones = _mm_set1_epi32(-1);
+        const __m128i one = _mm_set_epi32(0, 1, 0, 1);
+        const __m128i lastShift = _mm_cvtsi32_si128(patternLength - 1);
+
+        __m128i pv = ones;
+        __m128i mv = _mm_setzero_si128();
+        __m128i score = _mm_set_epi32(0, patternLength, 0, patternLength);
+        uint64_t eqs[2];
+        uint64_t active[2];
+        uint64_t scores[2];
+        for (int j=0; j < maxLength; ++j) {
+            for (size_t l=0; l < 2; ++l) {
+                if (j < lengths[l]) {
+                    eqs[l] = peq[static_cast<unsigned char>(texts[l][j])];
+                    active[l] = ~uint64_t(0);
+                } else {
+                    eqs[l] = 0;
+                    active[l] = 0;
+                }
+            }
+            const __m128i eq = _mm_set_epi64x(eqs[1], eqs[0]);
+            const __m128i isActive = _mm_set_epi64x(active[1], active[0]);
+
+            const __m128i xv = _mm_or_si128(eq, mv);
+            const __m128i xh = _mm_or_si128(_mm_xor_si128(_mm_add_epi64(_mm_and_si128(eq, pv), pv), pv), eq);
+            __m128i ph = _mm_or_si128(mv, _mm_andnot_si128(_mm_or_si128(xh, pv), ones));
+            __m128i mh = _mm_and_si128(pv, xh);
+
+            const __m128i delta = _mm_sub_epi64(_mm_and_si128(_mm_srl_epi64(ph, lastShift), one),
+                                                _mm_and_si128(_mm_srl_epi64(mh, lastShift), one));
+            score = _mm_add_epi64(score, _mm_and_si128(delta, isActive));
+
+            ph = _mm_or_si128(_mm_slli_epi64(ph, 1), one);
+            mh = _mm_slli_epi64(mh, 1);
+            pv = _mm_or_si128(mh, _mm_andnot_si128(_mm_or_si128(xv, ph), ones));
+            mv = _mm_and_si128(ph, xv);
+
+            if (bounded && (j + 1) % bound_check_interval == 0) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(scores), score);
+                if (!AnyLaneInBound(scores, lengths, 2, patternLength, j + 1, maxDist)) {
+                    for (size_t l=0; l < 2; ++l)
+                        dists[l] = maxDist + 1;
+                    return;
+                }
+            }
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(scores), score);
+        for (size_t l=0; l < 2; ++l)
+            dists[l] = min(static_cast<int>(scores[l]), bounded ? maxDist + 1 : INT_MAX);
+    }
+#endif
+
+    LevenshteinPattern::LevenshteinPattern() : patternLength(0), blockCount(0) {}
+
+    LevenshteinPattern::LevenshteinPattern(const boost::string_ref pattern) : patternLength(0), blockCount(0) {
+        Assign(pattern);
+    }
+
+    void LevenshteinPattern::Assign(const boost::string_ref pattern) {
+        patternLength = pattern.length();
+        blockCount = (patternLength + 63) / 64;
+
+        //Reuse the existing buffers, only growing them if necessary.
+        peq.resize(max(peq.size(), 256 * blockCount));
+        fill(peq.begin(), peq.begin() + 256 * blockCount, 0);
+        if (blockCount > 1) {
+            pv.resize(max(pv.size(), blockCount));
+            mv.resize(max(mv.size(), blockCount));
+            scores.resize(max(scores.size(), blockCount));
+        }
+
+        //Bits for each block of a character are stored together, as that's how
+        //BlockedDistance() reads them.
+        for (size_t i=0; i < patternLength; ++i)
+            peq[static_cast<unsigned char>(pattern[i]) * blockCount + i / 64] |= uint64_t(1) << (i % 64);
+    }
+
+    int LevenshteinPattern::Distance(const boost::string_ref text, const int maxDist) {
+        if (patternLength == 0) {
+            const int dist = text.length();
+            return (dist > maxDist) ? maxDist + 1 : dist;
+        } else if (blockCount == 1)
+            return WordDistance(&peq[0], patternLength, text, maxDist);
+        else
+            return BlockedDistance(text, maxDist);
+    }
+
+    void LevenshteinPattern::Distances(const boost::string_ref * texts, size_t count, int * dists, const int maxDist) {
+#if defined(STREDIT_LEVENSHTEIN_AVX2) || defined(STREDIT_LEVENSHTEIN_SSE2)
+        if (blockCount == 1) {
+            while (count >= lanes) {
+                WordDistances(&peq[0], patternLength, texts, dists, maxDist);
+                texts += lanes;
+                dists += lanes;
+                count -= lanes;
+            }
+        }
+#endif
+        for (size_t i=0; i < count; ++i)
+            dists[i] = Distance(texts[i], maxDist);
+    }
+
+    size_t LevenshteinPattern::length() const {
+        return patternLength;
+    }
+
+    //Each block is advanced in turn for every text character, passing the
+    //horizontal delta of its last row down to the next block. The distance in
+    //each block's last row is tracked so that bounded calculations can give up
+    //once no row can lead to a distance within the bound.
+    int LevenshteinPattern::BlockedDistance(const boost::string_ref text, const int maxDist) {
+        const int m = patternLength;
+        const int n = text.length();
+        const bool bounded = maxDist < m + n;
+        if (bounded && abs(m - n) > maxDist)
+            return maxDist + 1;
+
+        const char * data = text.data();
+        const size_t lastBlock = blockCount - 1;
+        const unsigned int lastShift = (patternLength - 1) % 64;
+
+        fill(pv.begin(), pv.begin() + blockCount, ~uint64_t(0));
+        fill(mv.begin(), mv.begin() + blockCount, 0);
+        for (size_t b=0; b < blockCount; ++b)
+            scores[b] = min(64 * (b + 1), patternLength);
+
+        for (int j=0; j < n; ++j) {
+            const uint64_t * eqs = &peq[static_cast<unsigned char>(data[j]) * blockCount];
+            int hin = 1;  //The top row always increases by one.
+            for (size_t b=0; b < blockCount; ++b) {
+                const uint64_t hinIsNegative = (hin < 0) ? 1 : 0;
+                uint64_t eq = eqs[b];
+                const uint64_t xv = eq | mv[b];
+                eq |= hinIsNegative;
+                const uint64_t xh = (((eq & pv[b]) + pv[b]) ^ pv[b]) | eq;
+                uint64_t ph = mv[b] | ~(xh | pv[b]);
+                uint64_t mh = pv[b] & xh;
+
+                const unsigned int shift = (b == lastBlock) ? lastShift : 63;
+                const int hout = static_cast<int>((ph >> shift) & 1) - static_cast<int>((mh >> shift) & 1);
+
+                ph = (ph << 1) | ((hin > 0) ? 1 : 0);
+                mh = (mh << 1) | hinIsNegative;
+                pv[b] = mh | ~(xv | ph);
+                mv[b] = ph & xv;
+                scores[b] += hout;
+                hin = hout;
+            }
+
+            if (bounded && (j + 1) % bound_check_interval == 0) {
+                int bound = INT_MAX;
+                int top = 0;
+                int topScore = j + 1;
+                for (size_t b=0; b < blockCount && bound > maxDist; ++b) {
+                    const int bottom = min(64 * (b + 1), patternLength);
+                    bound = min(bound, RowRangeBound(top, topScore, bottom, scores[b], m - n + j + 1));
+                    top = bottom;
+                    topScore = scores[b];
+                }
+                if (bound > maxDist)
+                    return maxDist + 1;
+            }
+        }
+
+        if (bounded && scores[lastBlock] > maxDist)
+            return maxDist + 1;
+        return scores[lastBlock];
+    }
+
+    void BuildHistogram(const boost::string_ref str, uint8_t * bins) {
+        memset(bins, 0, histogram_bins);
+        for (boost::string_ref::const_iterator it=str.begin(), endIt=str.end(); it != endIt; ++it) {
+            uint8_t& bin = bins[static_cast<unsigned char>(*it) % histogram_bins];
+            if (bin < 255)
+                ++bin;
+        }
+    }
+
+    //Each edit changes at most one bin count up and one down, so the larger
+    //of the total surplus and the total deficit is a lower bound. Saturated
+    //counts only ever shrink the difference, so the bound stays valid.
+    int HistogramDistance(const uint8_t * first, const uint8_t * second) {
+#if defined(STREDIT_LEVENSHTEIN_AVX2) || defined(STREDIT_LEVENSHTEIN_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+        const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first + 16));
+        const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(second));
+        const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(second + 16));
+        const __m128i surplus = _mm_add_epi64(_mm_sad_epu8(_mm_subs_epu8(a0, b0), zero), _mm_sad_epu8(_mm_subs_epu8(a1, b1), zero));
+        const __m128i deficit = _mm_add_epi64(_mm_sad_epu8(_mm_subs_epu8(b0, a0), zero), _mm_sad_epu8(_mm_subs_epu8(b1, a1), zero));
+        const int totalSurplus = _mm_cvtsi128_si32(surplus) + _mm_cvtsi128_si32(_mm_srli_si128(surplus, 8));
+        const int totalDeficit = _mm_cvtsi128_si32(deficit) + _mm_cvtsi128_si32(_mm_srli_si128(deficit, 8));
+#else
+        int totalSurplus = 0;
+        int totalDeficit = 0;
+        for (size_t i=0; i < histogram_bins; ++i) {
+            if (first[i] > second[i])
+                totalSurplus += first[i] - second[i];
+            else
+                totalDeficit += second[i] - first[i];
+        }
+#endif
+        return max(totalSurplus, totalDeficit);
+    }
+
+    int Levenshtein(const boost::string_ref first, const boost::string_ref second) {
+        return Levenshtein(first, second, INT_MAX);
+    }
+
+    int Levenshtein(const boost::string_ref first, const boost::string_ref second, const int maxDist) {
+        //The distance is symmetric, so use the shorter string as the pattern.
+        const boost::string_ref pattern = (first.length() <= second.length()) ? first : second;
+        const boost::string_ref text = (first.length() <= second.length()) ? second : first;
+
+        if (pattern.empty()) {
+            const int dist = text.length();
+            return (dist > maxDist) ? maxDist + 1 : dist;
+        } else if (pattern.length() <= 64) {
+            uint64_t peq[256];
+            memset(peq, 0, sizeof(peq));
+            for (size_t i=0; i < pattern.length(); ++i)
+                peq[static_cast<unsigned char>(pattern[i])] |= uint64_t(1) << i;
+            return WordDistance(peq, pattern.length(), text, maxDist);
+        } else
+            return LevenshteinPattern(pattern).Distance(text, maxDist);
+    }
+}
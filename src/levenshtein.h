@@ -0,0 +1,89 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __STREDIT_LEVENSHTEIN_H__
+#define __STREDIT_LEVENSHTEIN_H__
+
+#include <stdint.h>
+#include <climits>
+#include <string>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+
+namespace stredit {
+    //Calculates the Levenshtein distances between one pattern string and any
+    //number of other strings, using Myers' bit-parallel algorithm. Patterns
+    //longer than 64 bytes are split into 64-bit blocks, as described by Hyyrö.
+    //Distances are between byte strings, as for the UTF-8 data StrEdit uses.
+    //
+    //Buffers are kept between calls, so once a pattern has been assigned no
+    //distance calculation allocates memory. An object must not be used by more
+    //than one thread at a time.
+    class LevenshteinPattern {
+    public:
+        LevenshteinPattern();
+        explicit LevenshteinPattern(const boost::string_ref pattern);
+
+        void Assign(const boost::string_ref pattern);
+
+        //If the distance is greater than maxDist, maxDist + 1 is returned
+        //instead, and the calculation stops as soon as the result is known to
+        //be out of bounds.
+        int Distance(const boost::string_ref text, const int maxDist = INT_MAX);
+
+        //Outputs the distances to count texts into dists, bounded as above.
+        //Short patterns are scored against several texts at once using SSE2
+        //or AVX2 if available.
+        void Distances(const boost::string_ref * texts, size_t count, int * dists, const int maxDist = INT_MAX);
+
+        size_t length() const;
+
+        //The number of texts that Distances() scores at once, and the most it
+        //can score at once on any platform.
+        static const size_t lanes;
+        static const size_t max_lanes = 4;
+    private:
+        int BlockedDistance(const boost::string_ref text, const int maxDist);
+
+        std::vector<uint64_t> peq;  //256 bitmasks of character positions per block.
+        std::vector<uint64_t> pv;   //Working state for blocked distances.
+        std::vector<uint64_t> mv;
+        std::vector<int> scores;    //The distance in the last row of each block.
+        size_t patternLength;
+        size_t blockCount;
+    };
+
+    //Calculates the Levenshtein distance between two strings. The bounded
+    //version returns maxDist + 1 if the distance is greater than maxDist.
+    int Levenshtein(const boost::string_ref first, const boost::string_ref second);
+    int Levenshtein(const boost::string_ref first, const boost::string_ref second, const int maxDist);
+
+    //A string's byte counts, folded into histogram_bins bins and saturating
+    //at 255. The histograms of two strings give a lower bound on their
+    //Levenshtein distance that is much cheaper to calculate.
+    const size_t histogram_bins = 32;
+    void BuildHistogram(const boost::string_ref str, uint8_t * bins);
+    int HistogramDistance(const uint8_t * first, const uint8_t * second);
+}
+
+#endif
@@ -0,0 +1,187 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "matchcache.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <boost/locale.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+using namespace std;
+using boost::locale::translate;
+
+namespace stredit {
+    //The header takes up the space of one record, so that records are aligned.
+    static const char cache_magic[8] = { 'S', 'T', 'R', 'E', 'D', 'M', 'C', 0 };
+    static const uint32_t cache_version = 2;
+
+    //Files are only compacted once they have at least this many records for
+    //other fingerprints.
+    static const size_t min_stale_records = 4096;
+
+    MatchCache::MatchCache() : fingerprint(0) {}
+
+    void MatchCache::Open(const std::string& newPath, const uint64_t newFingerprint) {
+        path = newPath;
+        fingerprint = newFingerprint;
+        records.clear();
+        pending.clear();
+
+        boost::system::error_code ec;
+        if (boost::filesystem::file_size(path, ec) == 0 || ec) {
+            Compact();  //Creates the file.
+            return;
+        }
+
+        //Records for the same string supersede earlier ones, though they
+        //should only differ if the string has a hash collision.
+        size_t stale = 0;
+        try {
+            boost::interprocess::file_mapping file(path.c_str(), boost::interprocess::read_only);
+            boost::interprocess::mapped_region region(file, boost::interprocess::read_only);
+            const char * data = static_cast<const char *>(region.get_address());
+            const size_t size = region.get_size();
+
+            uint32_t version;
+            if (size >= sizeof(record))
+                memcpy(&version, data + sizeof(cache_magic), sizeof(version));
+            if (size < sizeof(record) || memcmp(data, cache_magic, sizeof(cache_magic)) != 0 || version != cache_version)
+                throw runtime_error(translate("Match cache file is invalid."));
+
+            for (size_t offset=sizeof(record); offset + sizeof(record) <= size; offset += sizeof(record)) {
+                record r;
+                memcpy(&r, data + offset, sizeof(record));
+                if (r.checksum != GetChecksum(r) || r.fingerprint != fingerprint || r.found > r.count || r.count > max_cached_matches)
+                    ++stale;
+                else
+                    records[r.hash] = r;
+            }
+        } catch (boost::interprocess::interprocess_exception& /*e*/) {
+            throw runtime_error(translate("Could not open match cache file."));
+        }
+
+        if (stale >= min_stale_records && stale > records.size())
+            Compact();
+    }
+
+    //The closest matches of a longer search are also the closest matches of
+    //a shorter one, so can be used for it.
+    bool MatchCache::Find(const boost::string_ref str, const size_t count, fuzzy_match * matches, size_t& found) const {
+        boost::unordered_map<uint64_t, record>::const_iterator it = records.find(StableHash(str.data(), str.length()));
+        if (it == records.end() || it->second.length != str.length() || it->second.count < count)
+            return false;
+
+        found = min<size_t>(it->second.found, count);
+        for (size_t i=0; i < found; ++i) {
+            matches[i].entry = it->second.entries[i];
+            matches[i].dist = it->second.dists[i];
+        }
+        return true;
+    }
+
+    void MatchCache::Add(const boost::string_ref str, const size_t count, const fuzzy_match * matches, const size_t found) {
+        if (count > max_cached_matches)
+            return;
+
+        record r;
+        memset(&r, 0, sizeof(record));
+        r.fingerprint = fingerprint;
+        r.hash = StableHash(str.data(), str.length());
+        r.length = str.length();
+        r.count = count;
+        for (size_t i=0; i < found; ++i) {
+            r.entries[i] = matches[i].entry;
+            r.dists[i] = matches[i].dist;
+        }
+        r.found = found;
+        r.checksum = GetChecksum(r);
+
+        boost::lock_guard<boost::mutex> lock(pendingMutex);
+        pending.push_back(r);
+    }
+
+    //The records are appended with a single unbuffered write, so that they
+    //don't get interleaved with records from other runs.
+    void MatchCache::Flush() {
+        if (pending.empty())
+            return;
+
+        //Pad out any incomplete record left by an interrupted write, so that
+        //the new records are aligned.
+        boost::system::error_code ec;
+        const uintmax_t size = boost::filesystem::file_size(path, ec);
+        if (ec)
+            throw runtime_error(translate("Could not write match cache file."));
+        std::string buffer((sizeof(record) - size % sizeof(record)) % sizeof(record), '\0');
+        buffer.append(reinterpret_cast<const char *>(&pending[0]), pending.size() * sizeof(record));
+
+        boost::filesystem::ofstream out;
+        out.rdbuf()->pubsetbuf(0, 0);
+        out.open(path, ios::binary | ios::app);
+        out.write(buffer.data(), buffer.length());
+        out.close();
+        if (out.fail())
+            throw runtime_error(translate("Could not write match cache file."));
+
+        for (vector<record>::const_iterator it=pending.begin(), endIt=pending.end(); it != endIt; ++it)
+            records[it->hash] = *it;
+        pending.clear();
+    }
+
+    size_t MatchCache::size() const {
+        return records.size();
+    }
+
+    uint32_t MatchCache::GetChecksum(const record& r) {
+        return static_cast<uint32_t>(StableHash(reinterpret_cast<const char *>(&r), offsetof(record, checksum)));
+    }
+
+    //Rewrites the file with only the current fingerprint's records. Results
+    //appended by other runs while this happens may be lost, but that only
+    //means their strings get searched for again.
+    void MatchCache::Compact() {
+        std::string buffer(sizeof(record), '\0');
+        memcpy(&buffer[0], cache_magic, sizeof(cache_magic));
+        memcpy(&buffer[sizeof(cache_magic)], &cache_version, sizeof(cache_version));
+        for (boost::unordered_map<uint64_t, record>::const_iterator it=records.begin(), endIt=records.end(); it != endIt; ++it)
+            buffer.append(reinterpret_cast<const char *>(&it->second), sizeof(record));
+
+        const boost::filesystem::path tempPath = path + ".tmp";
+        boost::filesystem::ofstream out(tempPath, ios::binary | ios::trunc);
+        out.write(buffer.data(), buffer.length());
+        out.close();
+        if (out.fail())
+            throw runtime_error(translate("Could not write match cache file."));
+
+        boost::system::error_code ec;
+        boost::filesystem::rename(tempPath, path, ec);
+        if (ec)
+            throw runtime_error(translate("Could not write match cache file."));
+    }
+}
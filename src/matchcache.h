@@ -0,0 +1,95 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __STREDIT_MATCHCACHE_H__
+#define __STREDIT_MATCHCACHE_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include "fuzzy.h"
+
+namespace stredit {
+    //The most matches that can be cached for a string.
+    const size_t max_cached_matches = 4;
+
+    //A file of fuzzy match results, so that strings matched in an earlier run
+    //don't have to be searched for again. Results are keyed on a hash of the
+    //string and the fingerprint of the FuzzyIndex used to find them, and
+    //store the closest entries of the index and their distances.
+    //
+    //The file is a header followed by fixed-size records, and is only ever
+    //appended to, so several runs can share it. Each record has a checksum,
+    //and records that are incomplete or fail their checksum are ignored.
+    class MatchCache : private boost::noncopyable {
+    public:
+        MatchCache();
+
+        //Reads the results for the given fingerprint from the file at path,
+        //creating it if it doesn't exist. Throws a runtime_error if the file
+        //can't be read or isn't a match cache. If most of the file's records
+        //are for other fingerprints, it is compacted to hold only these ones.
+        void Open(const std::string& path, const uint64_t fingerprint);
+
+        //Find() and Add() can be called from several threads at once, but not
+        //at the same time as Open() or Flush(). count is the number of matches
+        //searched for, and found is the number of those the search found.
+        //Find() only succeeds if at least count matches were searched for.
+        bool Find(const boost::string_ref str, const size_t count, fuzzy_match * matches, size_t& found) const;
+        void Add(const boost::string_ref str, const size_t count, const fuzzy_match * matches, const size_t found);
+
+        //Appends the results added since the file was opened or last flushed.
+        void Flush();
+
+        size_t size() const;
+    private:
+        struct record {
+            uint64_t fingerprint;
+            uint64_t hash;      //Of the string.
+            uint32_t length;    //Of the string, to make collisions even less likely.
+            uint32_t count;     //Of matches searched for.
+            uint32_t entries[max_cached_matches];
+            int32_t dists[max_cached_matches];
+            uint32_t found;
+            uint32_t checksum;  //Of the fields above.
+        };
+
+        static uint32_t GetChecksum(const record& r);
+        void Compact();
+
+        std::string path;
+        uint64_t fingerprint;
+        boost::unordered_map<uint64_t, record> records;  //Keyed by hash.
+
+        boost::mutex pendingMutex;
+        std::vector<record> pending;
+    };
+}
+
+#endif
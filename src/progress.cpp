@@ -23,15 +23,31 @@
 
 #include "progress.h"
 
-#include <wx/progdlg.h>
-#include <wx/msgdlg.h>
+#include <boost/thread/locks.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 namespace stredit {
-    void update_progress(void * ptr, const std::string message, int percentage) {
-        wxProgressDialog * pd = (wxProgressDialog*)ptr;
-        if (percentage == 100)
-            percentage = 99;
+    ProgressState::ProgressState() : done(0), total(0), startTime(boost::posix_time::microsec_clock::universal_time()) {}
+
+    void ProgressState::Start(const std::string& newMessage, const size_t newTotal) {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        message = newMessage;
+        startTime = boost::posix_time::microsec_clock::universal_time();
+        done.store(0, boost::memory_order_relaxed);
+        total.store(newTotal, boost::memory_order_relaxed);
+    }
+
+    void ProgressState::Advance(const size_t count) {
+        done.fetch_add(count, boost::memory_order_relaxed);
+    }
 
-        pd->Update(percentage, message);
+    progress_info ProgressState::GetInfo() const {
+        progress_info info;
+        boost::lock_guard<boost::mutex> lock(mutex);
+        info.message = message;
+        info.done = done.load(boost::memory_order_relaxed);
+        info.total = total.load(boost::memory_order_relaxed);
+        info.elapsed = boost::posix_time::microsec_clock::universal_time() - startTime;
+        return info;
     }
 }
@@ -25,9 +25,44 @@
 #define __STREDIT_PROGRESS_H__
 
 #include <string>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 namespace stredit {
-    void update_progress(void * progDiaPtr, const std::string message, int percentage);
+    //A snapshot of a ProgressState. A total of zero means that the amount of
+    //work in the current stage isn't known.
+    struct progress_info {
+        progress_info() : done(0), total(0) {}
+
+        std::string message;
+        size_t done;
+        size_t total;
+        boost::posix_time::time_duration elapsed;  //Since the stage started.
+    };
+
+    //The progress of an operation, which may be running on several threads.
+    //The operation starts each stage of its work with Start(), then calls
+    //Advance() as it finishes units of work. Advancing only bumps a counter,
+    //so is cheap enough to do for every unit. Whatever displays the progress
+    //polls GetInfo() as often as it wants to refresh.
+    class ProgressState : private boost::noncopyable {
+    public:
+        ProgressState();
+
+        void Start(const std::string& message, const size_t total);
+        void Advance(const size_t count = 1);
+
+        progress_info GetInfo() const;
+    private:
+        boost::atomic<size_t> done;
+        boost::atomic<size_t> total;
+
+        mutable boost::mutex mutex;  //Guards the stage's message and start time.
+        std::string message;
+        boost::posix_time::ptime startTime;
+    };
 }
 
 #endif
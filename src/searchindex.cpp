@@ -0,0 +1,461 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "searchindex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <boost/bind.hpp>
+#include <boost/locale.hpp>
+
+using namespace std;
+
+namespace stredit {
+    //Sorts the suffixes of text by prefix doubling: each round sorts them by
+    //twice as many leading characters as the last, using the ranks given by
+    //the last round as the keys of a counting sort. Suffixes are compared as
+    //if the text wrapped around, which doesn't change the order of the text
+    //before each null separator, and that is all that needs to be in order,
+    //so the rounds stop once they have sorted the longest string.
+    static void SortSuffixes(const std::string& text, const size_t longest, std::vector<uint32_t>& suffixes, const CancelToken * cancel) {
+        const size_t n = text.length();
+        suffixes.resize(n);
+        if (n == 0)
+            return;
+
+        vector<uint32_t> ranks(n);
+        vector<uint32_t> temp(n);
+        vector<uint32_t> counts(max<size_t>(n, 256), 0);
+
+        for (size_t i=0; i < n; ++i)
+            ++counts[static_cast<unsigned char>(text[i])];
+        for (size_t i=1; i < 256; ++i)
+            counts[i] += counts[i - 1];
+        for (size_t i=n; i-- > 0; )
+            suffixes[--counts[static_cast<unsigned char>(text[i])]] = i;
+
+        size_t classes = 1;
+        ranks[suffixes[0]] = 0;
+        for (size_t i=1; i < n; ++i) {
+            if (text[suffixes[i]] != text[suffixes[i - 1]])
+                ++classes;
+            ranks[suffixes[i]] = classes - 1;
+        }
+
+        for (size_t length=1; length < longest && classes < n; length *= 2) {
+            CancelToken::Check(cancel);
+
+            //Ordering the suffixes that start length characters earlier
+            //sorts them by the second half of their keys, so a stable sort
+            //by the first half then sorts them by the whole key.
+            for (size_t i=0; i < n; ++i)
+                temp[i] = (suffixes[i] >= length) ? suffixes[i] - length : suffixes[i] + n - length;
+            fill(counts.begin(), counts.begin() + classes, 0);
+            for (size_t i=0; i < n; ++i)
+                ++counts[ranks[temp[i]]];
+            for (size_t i=1; i < classes; ++i)
+                counts[i] += counts[i - 1];
+            for (size_t i=n; i-- > 0; )
+                suffixes[--counts[ranks[temp[i]]]] = temp[i];
+
+            temp[suffixes[0]] = 0;
+            classes = 1;
+            for (size_t i=1; i < n; ++i) {
+                const size_t current = suffixes[i];
+                const size_t previous = suffixes[i - 1];
+                if (ranks[current] != ranks[previous] || ranks[(current + length) % n] != ranks[(previous + length) % n])
+                    ++classes;
+                temp[current] = classes - 1;
+            }
+            ranks.swap(temp);
+        }
+    }
+
+    //Searches between begin and end for text, returning end if it isn't
+    //found. Candidates are found by looking for the text's first character
+    //with memchr() and checked with memcmp(), which the C library implements
+    //with vector instructions, so long runs of text that can't match are
+    //skipped many bytes at a time.
+    static const char * FindText(const char * begin, const char * end, const std::string& text) {
+        const size_t length = text.length();
+        if (length == 0)
+            return begin;
+
+        while (static_cast<size_t>(end - begin) >= length) {
+            const char * found = static_cast<const char *>(memchr(begin, text[0], end - begin - length + 1));
+            if (found == NULL)
+                break;
+            if (memcmp(found + 1, text.data() + 1, length - 1) == 0)
+                return found;
+            begin = found + 1;
+        }
+        return end;
+    }
+
+    static bool ContainsText(const boost::string_ref str, const std::string& text) {
+        return text.empty() || FindText(str.data(), str.data() + str.length(), text) != str.data() + str.length();
+    }
+
+    //Compares the text at a position in a buffer with the text searched for,
+    //up to the length of the text searched for.
+    struct suffix_compare {
+        explicit suffix_compare(const std::string& folded) : folded(folded) {}
+
+        bool operator () (const uint32_t pos, const std::string& text) const {
+            return folded.compare(pos, text.length(), text) < 0;
+        }
+
+        bool operator () (const std::string& text, const uint32_t pos) const {
+            return folded.compare(pos, text.length(), text) > 0;
+        }
+
+        const std::string& folded;
+    };
+
+    SearchIndex::column_index::column_index() : longest(0) {}
+
+    void SearchIndex::column_index::Append(const std::string& str) {
+        offsets.push_back(folded.length());
+        folded += str;
+        folded += '\0';
+        longest = max(longest, str.length() + 1);
+    }
+
+    //The null separators sort before everything else, so the suffixes that
+    //start with them come first, and are dropped as they can't match.
+    void SearchIndex::column_index::Index(const CancelToken * cancel) {
+        offsets.push_back(folded.length());
+        SortSuffixes(folded, longest, suffixes, cancel);
+        suffixes.erase(suffixes.begin(), suffixes.begin() + (offsets.size() - 1));
+    }
+
+    void SearchIndex::column_index::Clear() {
+        column_index().swap(*this);
+    }
+
+    //If the text is so common that it would be quicker, the buffer is
+    //searched directly, skipping to the next string after each match.
+    void SearchIndex::column_index::Find(const std::string& text, std::vector<int>& positions, const CancelToken * cancel) const {
+        positions.clear();
+        if (offsets.empty())
+            return;
+
+        const size_t count = offsets.size() - 1;
+        if (text.empty()) {
+            for (size_t i=0; i < count; ++i)
+                positions.push_back(i);
+            return;
+        }
+
+        const suffix_compare compare(folded);
+        const vector<uint32_t>::const_iterator first = lower_bound(suffixes.begin(), suffixes.end(), text, compare);
+        const vector<uint32_t>::const_iterator last = upper_bound(first, suffixes.end(), text, compare);
+        if (size_t(last - first) > count) {
+            const char * end = folded.data() + folded.length();
+            const char * pos = FindText(folded.data(), end, text);
+            while (pos != end) {
+                CancelToken::Check(cancel);
+                const size_t position = upper_bound(offsets.begin(), offsets.end(), uint32_t(pos - folded.data())) - offsets.begin() - 1;
+                positions.push_back(position);
+                pos = FindText(folded.data() + offsets[position + 1], end, text);
+            }
+            return;
+        }
+
+        for (vector<uint32_t>::const_iterator it=first; it != last; ++it) {
+            if ((it - first) % 4096 == 0)
+                CancelToken::Check(cancel);
+            positions.push_back(upper_bound(offsets.begin(), offsets.end(), *it) - offsets.begin() - 1);
+        }
+        CancelToken::Check(cancel);
+        sort(positions.begin(), positions.end());
+        positions.erase(unique(positions.begin(), positions.end()), positions.end());
+    }
+
+    boost::string_ref SearchIndex::column_index::GetString(const size_t position) const {
+        return boost::string_ref(folded.data() + offsets[position], offsets[position + 1] - offsets[position] - 1);
+    }
+
+    void SearchIndex::column_index::swap(column_index& other) {
+        folded.swap(other.folded);
+        offsets.swap(other.offsets);
+        suffixes.swap(other.suffixes);
+        std::swap(longest, other.longest);
+    }
+
+    SearchIndex::SearchIndex() : mergeDone(false) {}
+
+    SearchIndex::~SearchIndex() {
+        CancelMerge();
+    }
+
+    void SearchIndex::Build(const StringTable& stringList) {
+        CancelMerge();
+
+        column_index newOldIndex;
+        column_index newNewIndex;
+        newOldIndex.offsets.reserve(stringList.size() + 1);
+        newNewIndex.offsets.reserve(stringList.size() + 1);
+        for (size_t i=0, max=stringList.size(); i < max; ++i) {
+            const boost::string_ref oldString = stringList.GetOldString(i);
+            const boost::string_ref newString = stringList.GetNewString(i);
+            newOldIndex.Append(boost::locale::fold_case(oldString.begin(), oldString.end()));
+            newNewIndex.Append(boost::locale::fold_case(newString.begin(), newString.end()));
+        }
+        newOldIndex.Index(NULL);
+        newNewIndex.Index(NULL);
+
+        oldIndex.swap(newOldIndex);
+        newIndex.swap(newNewIndex);
+        edited.clear();
+    }
+
+    void SearchIndex::Update(const size_t position, const boost::string_ref newString) {
+        edited[position] = boost::locale::fold_case(newString.begin(), newString.end());
+
+        if (mergeDone)
+            FinishMerge();
+
+        //Edited strings are searched one by one, so once there are enough
+        //of them that would take a noticeable time, they get indexed.
+        if (!mergeThread.joinable() && edited.size() > max<size_t>(1024, size() / 8))
+            StartMerge();
+    }
+
+    void SearchIndex::Find(const std::string& text, const search_column column, std::vector<int>& positions, const CancelToken * cancel) const {
+        if (column == search_old)
+            oldIndex.Find(text, positions, cancel);
+        else if (column == search_new)
+            FindNew(text, positions, cancel);
+        else {
+            vector<int> oldPositions, newPositions;
+            oldIndex.Find(text, oldPositions, cancel);
+            FindNew(text, newPositions, cancel);
+            positions.clear();
+            set_union(oldPositions.begin(), oldPositions.end(), newPositions.begin(), newPositions.end(), back_inserter(positions));
+        }
+    }
+
+    void SearchIndex::Narrow(const std::string& text, const search_column column, std::vector<int>& positions, const CancelToken * cancel) const {
+        vector<int>::iterator last = positions.begin();
+        for (vector<int>::const_iterator it=positions.begin(), endIt=positions.end(); it != endIt; ++it) {
+            if ((it - positions.begin()) % 1024 == 0)
+                CancelToken::Check(cancel);
+            if (Contains(*it, text, column))
+                *last++ = *it;
+        }
+        positions.erase(last, positions.end());
+    }
+
+    size_t SearchIndex::size() const {
+        return oldIndex.offsets.empty() ? 0 : oldIndex.offsets.size() - 1;
+    }
+
+    //A running merge reads the index it was started for, so is cancelled.
+    void SearchIndex::swap(SearchIndex& other) {
+        CancelMerge();
+        other.CancelMerge();
+        oldIndex.swap(other.oldIndex);
+        newIndex.swap(other.newIndex);
+        edited.swap(other.edited);
+    }
+
+    //The indexed newStrings of edited strings are out of date, so they are
+    //replaced by the edited strings that match.
+    void SearchIndex::FindNew(const std::string& text, std::vector<int>& positions, const CancelToken * cancel) const {
+        newIndex.Find(text, positions, cancel);
+        if (edited.empty() && merging.empty())
+            return;
+
+        vector<int>::iterator last = positions.begin();
+        for (vector<int>::const_iterator it=positions.begin(), endIt=positions.end(); it != endIt; ++it) {
+            if ((it - positions.begin()) % 1024 == 0)
+                CancelToken::Check(cancel);
+            if (FindEdit(*it) == NULL)
+                *last++ = *it;
+        }
+        positions.erase(last, positions.end());
+
+        const size_t sortedEnd = positions.size();
+        size_t checked = 0;
+        for (boost::unordered_map<size_t, std::string>::const_iterator it=edited.begin(), endIt=edited.end(); it != endIt; ++it) {
+            if (checked++ % 1024 == 0)
+                CancelToken::Check(cancel);
+            if (ContainsText(it->second, text))
+                positions.push_back(it->first);
+        }
+        for (boost::unordered_map<size_t, std::string>::const_iterator it=merging.begin(), endIt=merging.end(); it != endIt; ++it) {
+            if (checked++ % 1024 == 0)
+                CancelToken::Check(cancel);
+            if (edited.find(it->first) == edited.end() && ContainsText(it->second, text))
+                positions.push_back(it->first);
+        }
+        CancelToken::Check(cancel);
+        sort(positions.begin() + sortedEnd, positions.end());
+        inplace_merge(positions.begin(), positions.begin() + sortedEnd, positions.end());
+    }
+
+    bool SearchIndex::Contains(const size_t position, const std::string& text, const search_column column) const {
+        if (column != search_new && ContainsText(oldIndex.GetString(position), text))
+            return true;
+        if (column == search_old)
+            return false;
+
+        const std::string * str = FindEdit(position);
+        if (str != NULL)
+            return ContainsText(*str, text);
+        return ContainsText(newIndex.GetString(position), text);
+    }
+
+    //Returns the folded newString of an edited string, or NULL if newIndex
+    //holds it. Edits made during a merge are newer than those being merged.
+    const std::string * SearchIndex::FindEdit(const size_t position) const {
+        boost::unordered_map<size_t, std::string>::const_iterator it = edited.find(position);
+        if (it != edited.end())
+            return &it->second;
+        it = merging.find(position);
+        if (it != merging.end())
+            return &it->second;
+        return NULL;
+    }
+
+    //The merge only reads newIndex and merging, which aren't changed until it
+    //has finished, so edits can carry on being made while it runs.
+    void SearchIndex::StartMerge() {
+        merging.swap(edited);
+        mergeCancel.reset(new CancelToken());
+        mergeDone = false;
+        boost::thread(boost::bind(&SearchIndex::Merge, this)).swap(mergeThread);
+    }
+
+    void SearchIndex::FinishMerge() {
+        mergeThread.join();
+        newIndex.swap(merged);
+        merged.Clear();
+        merging.clear();
+        mergeDone = false;
+    }
+
+    //The edits that were being merged are searched one by one again, unless
+    //they have been edited since.
+    void SearchIndex::CancelMerge() {
+        if (mergeThread.joinable()) {
+            mergeCancel->Cancel();
+            mergeThread.join();
+        }
+        edited.insert(merging.begin(), merging.end());
+        merging.clear();
+        merged.Clear();
+        mergeDone = false;
+    }
+
+    void SearchIndex::Merge() {
+        column_index index;
+        try {
+            index.offsets.reserve(newIndex.offsets.size());
+            for (size_t i=0, max=size(); i < max; ++i) {
+                if (i % 4096 == 0)
+                    CancelToken::Check(mergeCancel.get());
+                const boost::unordered_map<size_t, std::string>::const_iterator it = merging.find(i);
+                if (it != merging.end())
+                    index.Append(it->second);
+                else
+                    index.Append(newIndex.GetString(i).to_string());
+            }
+            index.Index(mergeCancel.get());
+        } catch (operation_cancelled& /*e*/) {
+            return;
+        }
+
+        merged.swap(index);
+        mergeDone = true;
+    }
+
+    SearchWorker::SearchWorker() : running(false), ready(false) {}
+
+    SearchWorker::~SearchWorker() {
+        Cancel();
+    }
+
+    void SearchWorker::Start(const SearchIndex& index, const std::string& text, const search_column column, const std::vector<int> * narrowFrom) {
+        Cancel();
+        cancel.reset(new CancelToken());
+        {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            if (narrowFrom != NULL)
+                result = *narrowFrom;
+            running = true;
+            ready = false;
+        }
+        boost::thread(boost::bind(&SearchWorker::Run, this, &index, text, column, narrowFrom != NULL)).swap(thread);
+    }
+
+    void SearchWorker::Cancel() {
+        if (thread.joinable()) {
+            cancel->Cancel();
+            thread.join();
+        }
+        boost::lock_guard<boost::mutex> lock(mutex);
+        ready = false;
+    }
+
+    bool SearchWorker::IsPending() const {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        return running || ready;
+    }
+
+    bool SearchWorker::TakeResult(std::vector<int>& positions) {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        if (!ready)
+            return false;
+        positions.swap(result);
+        ready = false;
+        return true;
+    }
+
+    //The search works on its own vector, so only holds the mutex to swap the
+    //result in and out, and TakeResult() never waits for a search to finish.
+    void SearchWorker::Run(const SearchIndex * index, const std::string text, const search_column column, const bool narrow) {
+        vector<int> positions;
+        {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            positions.swap(result);
+        }
+        try {
+            if (narrow)
+                index->Narrow(text, column, positions, cancel.get());
+            else
+                index->Find(text, column, positions, cancel.get());
+        } catch (operation_cancelled& /*e*/) {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            running = false;
+            return;
+        }
+
+        boost::lock_guard<boost::mutex> lock(mutex);
+        result.swap(positions);
+        running = false;
+        ready = true;
+    }
+}
@@ -0,0 +1,161 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __STREDIT_SEARCHINDEX_H__
+#define __STREDIT_SEARCHINDEX_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include "backend.h"
+#include "threadpool.h"
+
+namespace stredit {
+    //The strings of a string list that can be searched.
+    enum search_column {
+        search_old,
+        search_new,
+        search_both
+    };
+
+    //A full-text index of the case-folded original and new strings of a
+    //string list, for finding the strings that contain some text. Texts
+    //searched for must already be case-folded, using boost::locale::fold_case().
+    //
+    //Each column's strings are stored end to end in one buffer, separated by
+    //null characters so that no match can span two strings, and a suffix
+    //array of the buffer is binary searched to find all the matches at once.
+    //Editing a new string doesn't rebuild the array: the edited strings are
+    //searched separately until there are enough of them to be worth merging.
+    //They are then merged into a new array on a thread of the index's own,
+    //so that editing is never held up by it, and the edits made since are
+    //searched separately as before. The new array replaces the old one at
+    //the first edit after the merge has finished.
+    class SearchIndex : private boost::noncopyable {
+    public:
+        SearchIndex();
+        ~SearchIndex();
+
+        void Build(const StringTable& stringList);
+
+        //Updates the new string of the string at position. The index must
+        //not be searched while it is updated.
+        void Update(const size_t position, const boost::string_ref newString);
+
+        //Outputs the positions of the strings that contain text, in order.
+        void Find(const std::string& text, const search_column column, std::vector<int>& positions, const CancelToken * cancel = NULL) const;
+
+        //Removes the positions of strings that don't contain text. If the
+        //positions are those of the strings containing part of text, this
+        //gives the same result as Find(), but only searches those strings.
+        void Narrow(const std::string& text, const search_column column, std::vector<int>& positions, const CancelToken * cancel = NULL) const;
+
+        size_t size() const;
+        void swap(SearchIndex& other);
+    private:
+        struct column_index {
+            column_index();
+
+            //Strings are appended, then indexed once they have all been added.
+            void Append(const std::string& str);
+            void Index(const CancelToken * cancel);
+            void Clear();
+
+            void Find(const std::string& text, std::vector<int>& positions, const CancelToken * cancel) const;
+            boost::string_ref GetString(const size_t position) const;
+            void swap(column_index& other);
+
+            std::string folded;
+            std::vector<uint32_t> offsets;   //Of the start of each string, then the end of the last.
+            std::vector<uint32_t> suffixes;  //Positions in folded, in the order of the text following them.
+            size_t longest;                  //String length, including its separator.
+        };
+
+        void FindNew(const std::string& text, std::vector<int>& positions, const CancelToken * cancel) const;
+        bool Contains(const size_t position, const std::string& text, const search_column column) const;
+        const std::string * FindEdit(const size_t position) const;
+
+        //Merging is started once there are enough edits, and the merged
+        //array is taken by an edit made once the merge has finished.
+        void StartMerge();
+        void FinishMerge();
+        void CancelMerge();
+        void Merge();
+
+        column_index oldIndex;
+        column_index newIndex;
+        boost::unordered_map<size_t, std::string> edited;   //Folded newStrings that newIndex and merging don't hold.
+        boost::unordered_map<size_t, std::string> merging;  //Folded newStrings being merged into newIndex.
+
+        //Only the merge thread uses merged until mergeDone is set.
+        column_index merged;
+        boost::thread mergeThread;
+        boost::scoped_ptr<CancelToken> mergeCancel;
+        boost::atomic<bool> mergeDone;
+    };
+
+    //Runs searches of a SearchIndex on a worker thread, so that the thread
+    //starting them isn't held up. Starting a search cancels the one before
+    //it, and only the result of the last search started is kept. The index
+    //must not be changed while a search is running, so Cancel() should be
+    //called before changing it.
+    class SearchWorker : private boost::noncopyable {
+    public:
+        SearchWorker();
+        ~SearchWorker();
+
+        //Searches index for text in column. If narrowFrom isn't NULL, it is
+        //the result of searching for part of text, and is narrowed instead.
+        void Start(const SearchIndex& index, const std::string& text, const search_column column, const std::vector<int> * narrowFrom);
+
+        //Stops the running search, if there is one, and waits for it to end.
+        //Any result that hasn't been taken is discarded.
+        void Cancel();
+
+        //Returns true if a search is running or its result hasn't been taken.
+        bool IsPending() const;
+
+        //If the last search started has finished, swaps its result into
+        //positions and returns true. Otherwise returns false.
+        bool TakeResult(std::vector<int>& positions);
+    private:
+        void Run(const SearchIndex * index, const std::string text, const search_column column, const bool narrow);
+
+        boost::thread thread;
+        boost::scoped_ptr<CancelToken> cancel;
+
+        mutable boost::mutex mutex;  //Guards the result.
+        std::vector<int> result;
+        bool running;
+        bool ready;
+    };
+}
+
+#endif
@@ -0,0 +1,173 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "stringsfile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/locale.hpp>
+
+using namespace std;
+using boost::locale::translate;
+
+namespace stredit {
+    //Strings files start with the number of strings and the size of the data
+    //block, followed by a directory of string IDs and their offsets into the
+    //data block, which follows the directory.
+    static const size_t header_size = 2 * sizeof(uint32_t);
+    static const size_t directory_entry_size = 2 * sizeof(uint32_t);
+
+    static uint32_t ReadUint32(const char * data) {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    //Checks the encoding without decoding, as nearly all strings are UTF-8.
+    static bool IsUtf8(const char * str, const size_t length) {
+        const unsigned char * it = reinterpret_cast<const unsigned char *>(str);
+        const unsigned char * endIt = it + length;
+        while (it != endIt) {
+            if (*it < 0x80) {
+                ++it;
+                continue;
+            }
+
+            size_t trailing;
+            uint32_t codePoint;
+            if ((*it & 0xE0) == 0xC0) {
+                trailing = 1;
+                codePoint = *it & 0x1F;
+            } else if ((*it & 0xF0) == 0xE0) {
+                trailing = 2;
+                codePoint = *it & 0x0F;
+            } else if ((*it & 0xF8) == 0xF0) {
+                trailing = 3;
+                codePoint = *it & 0x07;
+            } else
+                return false;
+
+            if (static_cast<size_t>(endIt - it) <= trailing)
+                return false;
+            for (size_t i=1; i <= trailing; ++i) {
+                if ((it[i] & 0xC0) != 0x80)
+                    return false;
+                codePoint = (codePoint << 6) | (it[i] & 0x3F);
+            }
+
+            //Reject overlong forms, surrogates and values past the last code point.
+            static const uint32_t min_code_points[] = { 0, 0x80, 0x800, 0x10000 };
+            if (codePoint < min_code_points[trailing] || (codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF)
+                return false;
+
+            it += trailing + 1;
+        }
+        return true;
+    }
+
+    bool HasLengthPrefixes(const std::string& path) {
+        const string extension = boost::filesystem::path(path).extension().string();
+        return boost::iequals(extension, ".DLSTRINGS") || boost::iequals(extension, ".ILSTRINGS");
+    }
+
+    void StringsFile::Open(const std::string& path, const int fallbackEnc) {
+        boost::interprocess::file_mapping newFile;
+        boost::interprocess::mapped_region newRegion;
+        try {
+            boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only).swap(newFile);
+            boost::interprocess::mapped_region(newFile, boost::interprocess::read_only).swap(newRegion);
+        } catch (boost::interprocess::interprocess_exception& /*e*/) {
+            throw runtime_error(translate("Could not open strings file."));
+        }
+
+        //Length prefixes include the null terminator.
+        const bool lengthPrefixed = HasLengthPrefixes(path);
+
+        const char * data = static_cast<const char *>(newRegion.get_address());
+        const size_t size = newRegion.get_size();
+        if (size < header_size)
+            throw runtime_error(translate("Could not read strings file."));
+
+        const size_t count = ReadUint32(data);
+        const size_t dataSize = ReadUint32(data + sizeof(uint32_t));
+        if (count > (size - header_size) / directory_entry_size || dataSize > size - header_size - count * directory_entry_size)
+            throw runtime_error(translate("Could not read strings file."));
+
+        const char * directory = data + header_size;
+        const char * strings = directory + count * directory_entry_size;
+        const string fallbackCharset = "CP" + boost::lexical_cast<string>(fallbackEnc);
+
+        vector<entry> newEntries(count);
+        deque<string> newConverted;
+        for (size_t i=0; i < count; ++i) {
+            newEntries[i].id = ReadUint32(directory + i * directory_entry_size);
+            size_t offset = ReadUint32(directory + i * directory_entry_size + sizeof(uint32_t));
+            size_t maxLength = dataSize - min(offset, dataSize);
+            if (lengthPrefixed) {
+                if (maxLength < sizeof(uint32_t))
+                    throw runtime_error(translate("Could not read strings file."));
+                const size_t length = ReadUint32(strings + offset);
+                offset += sizeof(uint32_t);
+                maxLength = min<size_t>(maxLength - sizeof(uint32_t), length);
+            }
+
+            const char * str = strings + offset;
+            const char * end = static_cast<const char *>(memchr(str, '\0', maxLength));
+            if (end == NULL)
+                throw runtime_error(translate("Could not read strings file."));
+
+            if (IsUtf8(str, end - str))
+                newEntries[i].str = boost::string_ref(str, end - str);
+            else {
+                try {
+                    newConverted.push_back(boost::locale::conv::to_utf<char>(str, end, fallbackCharset, boost::locale::conv::stop));
+                } catch (boost::locale::conv::conversion_error& /*e*/) {
+                    throw runtime_error(translate("Could not read strings file."));
+                } catch (boost::locale::conv::invalid_charset_error& /*e*/) {
+                    throw runtime_error(translate("Could not read strings file."));
+                }
+                newEntries[i].str = newConverted.back();
+            }
+        }
+
+        file.swap(newFile);
+        region.swap(newRegion);
+        entries.swap(newEntries);
+        converted.swap(newConverted);
+    }
+
+    const std::vector<StringsFile::entry>& StringsFile::GetEntries() const {
+        return entries;
+    }
+
+    void StringsFile::swap(StringsFile& other) {
+        file.swap(other.file);
+        region.swap(other.region);
+        entries.swap(other.entries);
+        converted.swap(other.converted);
+    }
+}
@@ -0,0 +1,70 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __STREDIT_STRINGSFILE_H__
+#define __STREDIT_STRINGSFILE_H__
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/utility/string_ref.hpp>
+
+namespace stredit {
+    //Whether the strings in the file at path are prefixed with their lengths,
+    //as in DLSTRINGS and ILSTRINGS files, going by its extension.
+    bool HasLengthPrefixes(const std::string& path);
+
+    //A STRINGS, DLSTRINGS or ILSTRINGS file, memory-mapped so that its strings
+    //can be read in place. Only the directory of IDs and offsets is parsed
+    //when the file is opened, and the entries are views of the mapped strings,
+    //so they are only valid while the file stays open. Strings that aren't
+    //UTF-8 are the exception, as they are converted from the fallback encoding
+    //and stored separately.
+    class StringsFile : private boost::noncopyable {
+    public:
+        struct entry {
+            uint32_t id;
+            boost::string_ref str;
+        };
+
+        //Maps the file at path and reads its directory. Throws a runtime_error
+        //if the file can't be read, in which case the current contents are
+        //kept.
+        void Open(const std::string& path, const int fallbackEnc);
+
+        const std::vector<entry>& GetEntries() const;
+
+        void swap(StringsFile& other);
+    private:
+        boost::interprocess::file_mapping file;
+        boost::interprocess::mapped_region region;
+        std::vector<entry> entries;
+        std::deque<std::string> converted;  //Deque elements don't move, so views of them stay valid.
+    };
+}
+
+#endif
@@ -0,0 +1,176 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "stringtable.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <boost/locale.hpp>
+
+using namespace std;
+using boost::locale::translate;
+
+namespace stredit {
+    //The new strings buffer is only compacted once it has at least this
+    //many bytes of replaced strings, so small tables don't keep compacting.
+    static const size_t min_unused_bytes = 65536;
+
+    //Throws if a buffer would grow past what its 32-bit offsets can point to.
+    static void CheckPoolSize(const size_t size, const size_t added) {
+        if (added > numeric_limits<uint32_t>::max() - size)
+            throw runtime_error(translate("Too much string data to hold."));
+    }
+
+    StringTable::StringTable() : oldOffsets(1, 0), newUnused(0) {}
+
+    void StringTable::Append(const uint32_t id, const boost::string_ref oldString) {
+        CheckPoolSize(oldPool.length(), oldString.length());
+        ids.push_back(id);
+        fuzzy.push_back(false);
+        edited.push_back(false);
+        oldPool.append(oldString.data(), oldString.length());
+        oldOffsets.push_back(oldPool.length());
+        newOffsets.push_back(0);
+        newLengths.push_back(0);
+    }
+
+    void StringTable::Reserve(const size_t count, const size_t oldStringBytes) {
+        ids.reserve(count);
+        fuzzy.reserve(count);
+        edited.reserve(count);
+        oldPool.reserve(oldStringBytes);
+        oldOffsets.reserve(count + 1);
+        newOffsets.reserve(count);
+        newLengths.reserve(count);
+    }
+
+    void StringTable::Clear() {
+        StringTable().swap(*this);
+    }
+
+    uint32_t StringTable::GetId(const size_t i) const {
+        return ids[i];
+    }
+
+    boost::string_ref StringTable::GetOldString(const size_t i) const {
+        return boost::string_ref(oldPool.data() + oldOffsets[i], oldOffsets[i + 1] - oldOffsets[i]);
+    }
+
+    boost::string_ref StringTable::GetNewString(const size_t i) const {
+        return boost::string_ref(newPool.data() + newOffsets[i], newLengths[i]);
+    }
+
+    bool StringTable::HasNewString(const size_t i) const {
+        return newLengths[i] != 0;
+    }
+
+    bool StringTable::IsFuzzy(const size_t i) const {
+        return fuzzy[i];
+    }
+
+    bool StringTable::IsEdited(const size_t i) const {
+        return edited[i];
+    }
+
+    const std::vector<fuzzy_suggestion>& StringTable::GetSuggestions(const size_t i) const {
+        const boost::unordered_map<uint32_t, vector<fuzzy_suggestion> >::const_iterator it = suggestions.find(i);
+        if (it == suggestions.end())
+            return noSuggestions;
+        return it->second;
+    }
+
+    //A new string that fits in the space of the one it replaces is written
+    //over it, so editing a string to something shorter doesn't grow the buffer.
+    void StringTable::SetNewString(const size_t i, const boost::string_ref str) {
+        if (!str.empty() && str.data() >= newPool.data() && str.data() < newPool.data() + newPool.length()) {
+            //The string is in the buffer, which may move as it is appended to.
+            SetNewString(i, string(str.data(), str.length()));
+            return;
+        }
+
+        if (str.length() <= newLengths[i]) {
+            if (!str.empty())
+                memcpy(&newPool[newOffsets[i]], str.data(), str.length());
+            newUnused += newLengths[i] - str.length();
+        } else {
+            CheckPoolSize(newPool.length(), str.length());
+            newUnused += newLengths[i];
+            newOffsets[i] = newPool.length();
+            newPool.append(str.data(), str.length());
+        }
+        newLengths[i] = str.length();
+
+        if (newUnused >= min_unused_bytes && newUnused > newPool.length() / 2)
+            CompactNewStrings();
+    }
+
+    void StringTable::SetFuzzy(const size_t i, const bool isFuzzy) {
+        fuzzy[i] = isFuzzy;
+    }
+
+    void StringTable::SetEdited(const size_t i, const bool isEdited) {
+        edited[i] = isEdited;
+    }
+
+    void StringTable::SetSuggestions(const size_t i, const std::vector<fuzzy_suggestion>& newSuggestions) {
+        if (newSuggestions.empty())
+            suggestions.erase(i);
+        else
+            suggestions[i] = newSuggestions;
+    }
+
+    size_t StringTable::size() const {
+        return ids.size();
+    }
+
+    bool StringTable::empty() const {
+        return ids.empty();
+    }
+
+    void StringTable::swap(StringTable& other) {
+        ids.swap(other.ids);
+        fuzzy.swap(other.fuzzy);
+        edited.swap(other.edited);
+        oldPool.swap(other.oldPool);
+        oldOffsets.swap(other.oldOffsets);
+        newPool.swap(other.newPool);
+        newOffsets.swap(other.newOffsets);
+        newLengths.swap(other.newLengths);
+        std::swap(newUnused, other.newUnused);
+        suggestions.swap(other.suggestions);
+    }
+
+    void StringTable::CompactNewStrings() {
+        string compacted;
+        compacted.reserve(newPool.length() - newUnused);
+        for (size_t i=0, max=newOffsets.size(); i < max; ++i) {
+            const uint32_t offset = compacted.length();
+            compacted.append(newPool, newOffsets[i], newLengths[i]);
+            newOffsets[i] = offset;
+        }
+        newPool.swap(compacted);
+        newUnused = 0;
+    }
+}
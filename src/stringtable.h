@@ -0,0 +1,98 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __STREDIT_STRINGTABLE_H__
+#define __STREDIT_STRINGTABLE_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <boost/unordered_map.hpp>
+#include <boost/utility/string_ref.hpp>
+
+namespace stredit {
+    //A vocabulary entry close to a string, and how similar it is, from 0 for
+    //entirely different to 1 for identical.
+    struct fuzzy_suggestion {
+        std::string source;
+        std::string translation;
+        int dist;
+        float similarity;
+    };
+
+    //A table of strings, their translations and their state, stored column
+    //by column, so that going through the table for one thing only touches
+    //the memory that holds it. The original strings are copied end to end
+    //into one buffer when they are appended, so the table doesn't depend on
+    //the file they came from. New strings are kept in a separate buffer that
+    //grows as they are edited: a new string that is longer than the one it
+    //replaces is appended, and once most of the buffer is replaced strings,
+    //the buffer is compacted. Only machine translated strings have
+    //suggestions, so they are only stored for the strings that have them.
+    class StringTable {
+    public:
+        StringTable();
+
+        //Appends a string with no new string, that isn't fuzzy or edited.
+        void Append(const uint32_t id, const boost::string_ref oldString);
+        void Reserve(const size_t count, const size_t oldStringBytes);
+        void Clear();
+
+        uint32_t GetId(const size_t i) const;
+        boost::string_ref GetOldString(const size_t i) const;
+        //The view is only valid until a new string is next changed.
+        boost::string_ref GetNewString(const size_t i) const;
+        bool HasNewString(const size_t i) const;
+        bool IsFuzzy(const size_t i) const;  //For when using Levenshtein matching.
+        bool IsEdited(const size_t i) const;
+        const std::vector<fuzzy_suggestion>& GetSuggestions(const size_t i) const;  //Closest first, the first giving the new string.
+
+        void SetNewString(const size_t i, const boost::string_ref str);
+        void SetFuzzy(const size_t i, const bool fuzzy);
+        void SetEdited(const size_t i, const bool edited);
+        void SetSuggestions(const size_t i, const std::vector<fuzzy_suggestion>& suggestions);
+
+        size_t size() const;
+        bool empty() const;
+        void swap(StringTable& other);
+    private:
+        void CompactNewStrings();
+
+        std::vector<uint32_t> ids;
+        std::vector<bool> fuzzy;   //Packed, one bit per string.
+        std::vector<bool> edited;
+
+        std::string oldPool;
+        std::vector<uint32_t> oldOffsets;  //Of the start of each string, then the end of the last.
+
+        std::string newPool;
+        std::vector<uint32_t> newOffsets;
+        std::vector<uint32_t> newLengths;
+        size_t newUnused;  //Bytes of newPool taken up by replaced strings.
+
+        boost::unordered_map<uint32_t, std::vector<fuzzy_suggestion> > suggestions;  //Keyed by position.
+        std::vector<fuzzy_suggestion> noSuggestions;
+    };
+}
+
+#endif
@@ -0,0 +1,177 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "threadpool.h"
+
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/locale.hpp>
+
+using namespace std;
+using boost::locale::translate;
+
+namespace stredit {
+    WorkStealingPool::WorkStealingPool(size_t threadCount) : queued(0), unfinished(0), nextQueue(0), stopping(false) {
+        if (threadCount == 0)
+            threadCount = max(boost::thread::hardware_concurrency(), 1u);
+
+        for (size_t i=0; i < threadCount; ++i)
+            queues.push_back(new task_queue());
+        for (size_t i=0; i < threadCount; ++i)
+            threads.create_thread(boost::bind(&WorkStealingPool::Run, this, i));
+    }
+
+    WorkStealingPool::~WorkStealingPool() {
+        {
+            boost::unique_lock<boost::mutex> lock(stateMutex);
+            while (unfinished > 0)
+                allDone.wait(lock);
+            stopping = true;
+        }
+        workAvailable.notify_all();
+        threads.join_all();
+
+        for (size_t i=0; i < queues.size(); ++i)
+            delete queues[i];
+    }
+
+    void WorkStealingPool::Submit(const task& t) {
+        size_t index;
+        {
+            boost::lock_guard<boost::mutex> lock(stateMutex);
+            index = nextQueue;
+            nextQueue = (nextQueue + 1) % queues.size();
+            ++queued;
+            ++unfinished;
+        }
+        {
+            boost::lock_guard<boost::mutex> lock(queues[index]->mutex);
+            queues[index]->tasks.push_back(t);
+        }
+        workAvailable.notify_one();
+    }
+
+    void WorkStealingPool::Wait() {
+        {
+            boost::unique_lock<boost::mutex> lock(stateMutex);
+            while (unfinished > 0)
+                allDone.wait(lock);
+        }
+        RethrowError();
+    }
+
+    bool WorkStealingPool::Wait(const boost::posix_time::time_duration& timeout) {
+        {
+            const boost::system_time deadline = boost::get_system_time() + timeout;
+            boost::unique_lock<boost::mutex> lock(stateMutex);
+            while (unfinished > 0) {
+                if (!allDone.timed_wait(lock, deadline))
+                    return false;
+            }
+        }
+        RethrowError();
+        return true;
+    }
+
+    size_t WorkStealingPool::size() const {
+        return queues.size();
+    }
+
+    void WorkStealingPool::Run(const size_t index) {
+        while (true) {
+            task t;
+            if (TryPop(index, t)) {
+                try {
+                    t();
+                } catch (...) {
+                    boost::lock_guard<boost::mutex> lock(stateMutex);
+                    if (!error)
+                        error = boost::current_exception();
+                }
+
+                boost::lock_guard<boost::mutex> lock(stateMutex);
+                if (--unfinished == 0)
+                    allDone.notify_all();
+                continue;
+            }
+
+            boost::unique_lock<boost::mutex> lock(stateMutex);
+            while (queued == 0 && !stopping)
+                workAvailable.wait(lock);
+            if (queued == 0 && stopping)
+                return;
+        }
+    }
+
+    //Takes from the front of the worker's own queue, or failing that from the
+    //back of the next non-empty queue after it.
+    bool WorkStealingPool::TryPop(const size_t index, task& t) {
+        for (size_t i=0, max=queues.size(); i < max; ++i) {
+            task_queue& q = *queues[(index + i) % max];
+            boost::lock_guard<boost::mutex> lock(q.mutex);
+            if (q.tasks.empty())
+                continue;
+
+            if (i == 0) {
+                t = q.tasks.front();
+                q.tasks.pop_front();
+            } else {
+                t = q.tasks.back();
+                q.tasks.pop_back();
+            }
+
+            boost::lock_guard<boost::mutex> stateLock(stateMutex);
+            --queued;
+            return true;
+        }
+        return false;
+    }
+
+    void WorkStealingPool::RethrowError() {
+        boost::exception_ptr e;
+        {
+            boost::lock_guard<boost::mutex> lock(stateMutex);
+            e = error;
+            error = boost::exception_ptr();
+        }
+        if (e)
+            boost::rethrow_exception(e);
+    }
+
+    operation_cancelled::operation_cancelled() : runtime_error(translate("The operation was cancelled.")) {}
+
+    CancelToken::CancelToken() : cancelled(false) {}
+
+    void CancelToken::Cancel() {
+        cancelled.store(true, boost::memory_order_relaxed);
+    }
+
+    bool CancelToken::IsCancelled() const {
+        return cancelled.load(boost::memory_order_relaxed);
+    }
+
+    void CancelToken::Check(const CancelToken * token) {
+        if (token != NULL && token->IsCancelled())
+            throw boost::enable_current_exception(operation_cancelled());  //So it keeps its type when rethrown by WorkStealingPool.
+    }
+}
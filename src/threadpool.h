@@ -0,0 +1,107 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __STREDIT_THREADPOOL_H__
+#define __STREDIT_THREADPOOL_H__
+
+#include <deque>
+#include <stdexcept>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <boost/exception_ptr.hpp>
+
+namespace stredit {
+    //Runs tasks on a fixed set of worker threads. Tasks are dealt out to the
+    //workers' queues in the order they are submitted. Each worker runs tasks
+    //from the front of its own queue, and when that is empty it steals from
+    //the back of another worker's queue, so workers that are given cheap
+    //tasks help out those that were given expensive ones.
+    class WorkStealingPool : private boost::noncopyable {
+    public:
+        typedef boost::function<void ()> task;
+
+        //If threadCount is zero, one thread per hardware thread is created.
+        explicit WorkStealingPool(size_t threadCount = 0);
+
+        //Waits for all submitted tasks to finish before stopping the workers.
+        ~WorkStealingPool();
+
+        void Submit(const task& t);
+
+        //Blocks until all submitted tasks have finished. If a task threw an
+        //exception, the first one thrown is rethrown. The timed version
+        //returns false if the tasks hadn't finished by the timeout.
+        void Wait();
+        bool Wait(const boost::posix_time::time_duration& timeout);
+
+        size_t size() const;
+    private:
+        struct task_queue {
+            boost::mutex mutex;
+            std::deque<task> tasks;
+        };
+
+        void Run(const size_t index);
+        bool TryPop(const size_t index, task& t);
+        void RethrowError();
+
+        std::vector<task_queue *> queues;
+        boost::thread_group threads;
+
+        boost::mutex stateMutex;
+        boost::condition_variable workAvailable;
+        boost::condition_variable allDone;
+        size_t queued;      //Tasks waiting in queues.
+        size_t unfinished;  //Tasks submitted but not yet finished.
+        size_t nextQueue;
+        bool stopping;
+        boost::exception_ptr error;
+    };
+
+    //Thrown by operations that stop early because they were cancelled.
+    class operation_cancelled : public std::runtime_error {
+    public:
+        operation_cancelled();
+    };
+
+    //Lets an operation running on other threads be asked to stop. The
+    //operation checks it between units of work, so doesn't stop immediately.
+    class CancelToken : private boost::noncopyable {
+    public:
+        CancelToken();
+
+        void Cancel();
+        bool IsCancelled() const;
+
+        //Throws operation_cancelled if the token has been cancelled. Passing
+        //a NULL token is allowed, and never throws.
+        static void Check(const CancelToken * token);
+    private:
+        boost::atomic<bool> cancelled;
+    };
+}
+
+#endif
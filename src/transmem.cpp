@@ -0,0 +1,244 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "transmem.h"
+#include "backend.h"
+#include "progress.h"
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <boost/locale.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+using namespace std;
+using boost::locale::translate;
+
+namespace stredit {
+    //Translation memory files start with a header listing the vocab pairs and
+    //the stamps of their files, padded so that the fuzzy index's memory block
+    //that follows it is 8-byte aligned. Values are stored in native byte
+    //order, as the files are only meant to be used on the machine that built
+    //them.
+    static const char tm_magic[8] = { 'S', 'T', 'R', 'E', 'D', 'T', 'M', 0 };
+    static const uint32_t tm_version = 2;
+
+    template<class T>
+    static void WriteValue(std::ostream& out, const T value) {
+        out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    static void WriteString(std::ostream& out, const std::string& str) {
+        WriteValue<uint32_t>(out, str.length());
+        out.write(str.data(), str.length());
+    }
+
+    //Reads values from a header, throwing if that would read past its end.
+    struct header_reader {
+        header_reader(const char * pos, const char * end) : pos(pos), end(end) {}
+
+        template<class T>
+        T ReadValue() {
+            T value;
+            memcpy(&value, Advance(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        std::string ReadString() {
+            const uint32_t length = ReadValue<uint32_t>();
+            return std::string(Advance(length), length);
+        }
+
+        const char * Advance(const size_t count) {
+            if (static_cast<size_t>(end - pos) < count)
+                throw runtime_error(translate("Translation memory file is invalid."));
+            const char * start = pos;
+            pos += count;
+            return start;
+        }
+
+        const char * pos;
+        const char * end;
+    };
+
+    bool operator == (const vocab_pair& first, const vocab_pair& second) {
+        return first.source == second.source
+            && first.trans == second.trans
+            && first.sourceFallbackEnc == second.sourceFallbackEnc
+            && first.transFallbackEnc == second.transFallbackEnc;
+    }
+
+    void TranslationMemory::Build(const std::vector<vocab_pair>& newPairs, ProgressState * progress, const CancelToken * cancel) {
+        //Stamp the files before reading them, so that changes made while
+        //they're being read outdate the translation memory.
+        vector<file_stamp> newStamps;
+        vector<string> paths;
+        vector<int> fallbackEncs;
+        for (size_t i=0, max=newPairs.size(); i < max; ++i) {
+            newStamps.push_back(GetFileStamp(newPairs[i].source));
+            newStamps.push_back(GetFileStamp(newPairs[i].trans));
+            paths.push_back(newPairs[i].source);
+            paths.push_back(newPairs[i].trans);
+            fallbackEncs.push_back(newPairs[i].sourceFallbackEnc);
+            fallbackEncs.push_back(newPairs[i].transFallbackEnc);
+        }
+
+        //The files are read in parallel, but their strings are paired in the
+        //pairs' order, so that earlier pairs still take precedence. Each file
+        //read and each pair matched up is a unit of progress.
+        if (progress != NULL)
+            progress->Start(translate("Building Vocabulary..."), paths.size() + newPairs.size());
+        boost::ptr_vector<StringsFile> files;
+        OpenStringsFiles(paths, fallbackEncs, files, cancel, progress);
+        boost::unordered_map<std::string, std::string> stringMap;
+        for (size_t i=0, max=newPairs.size(); i < max; ++i) {
+            BuildStringPairs(files[2 * i], files[2 * i + 1], stringMap);
+            if (progress != NULL)
+                progress->Advance();
+        }
+
+        if (progress != NULL)
+            progress->Start(translate("Indexing vocabulary..."), 0);
+        CancelToken::Check(cancel);
+        index.Build(stringMap);
+        pairs = newPairs;
+        stamps.swap(newStamps);
+
+        //The index no longer uses any mapped file.
+        boost::interprocess::mapped_region().swap(region);
+        boost::interprocess::file_mapping().swap(file);
+    }
+
+    //The file is written under a temporary name and then renamed, so that an
+    //existing file is only replaced once the new one is complete.
+    void TranslationMemory::Save(const std::string& path) const {
+        ostringstream header;
+        header.write(tm_magic, sizeof(tm_magic));
+        WriteValue<uint32_t>(header, tm_version);
+        WriteValue<uint32_t>(header, pairs.size());
+        for (size_t i=0, max=pairs.size(); i < max; ++i) {
+            WriteString(header, pairs[i].source);
+            WriteString(header, pairs[i].trans);
+            WriteValue<int32_t>(header, pairs[i].sourceFallbackEnc);
+            WriteValue<int32_t>(header, pairs[i].transFallbackEnc);
+            for (size_t j=2 * i; j < 2 * i + 2; ++j) {
+                WriteValue<uint64_t>(header, stamps[j].size);
+                WriteValue<int64_t>(header, stamps[j].modified);
+            }
+        }
+        ostringstream block;
+        index.Write(block);
+        while (header.str().length() % 8 != 0)
+            header.put(0);
+        WriteValue<uint64_t>(header, block.str().length());
+
+        const boost::filesystem::path tempPath = path + ".tmp";
+        boost::filesystem::ofstream out(tempPath, ios::binary | ios::trunc);
+        out << header.str() << block.str();
+        out.close();
+        if (out.fail())
+            throw runtime_error(translate("Could not write translation memory file."));
+
+        boost::system::error_code ec;
+        boost::filesystem::rename(tempPath, path, ec);
+        if (ec)
+            throw runtime_error(translate("Could not write translation memory file."));
+    }
+
+    void TranslationMemory::Load(const std::string& path) {
+        boost::interprocess::file_mapping newFile;
+        boost::interprocess::mapped_region newRegion;
+        try {
+            boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only).swap(newFile);
+            boost::interprocess::mapped_region(newFile, boost::interprocess::read_only).swap(newRegion);
+        } catch (boost::interprocess::interprocess_exception& /*e*/) {
+            throw runtime_error(translate("Could not open translation memory file."));
+        }
+
+        const char * data = static_cast<const char *>(newRegion.get_address());
+        header_reader reader(data, data + newRegion.get_size());
+        if (memcmp(reader.Advance(sizeof(tm_magic)), tm_magic, sizeof(tm_magic)) != 0
+            || reader.ReadValue<uint32_t>() != tm_version)
+            throw runtime_error(translate("Translation memory file is invalid."));
+
+        vector<vocab_pair> newPairs(reader.ReadValue<uint32_t>());
+        vector<file_stamp> newStamps;
+        for (size_t i=0, max=newPairs.size(); i < max; ++i) {
+            newPairs[i].source = reader.ReadString();
+            newPairs[i].trans = reader.ReadString();
+            newPairs[i].sourceFallbackEnc = reader.ReadValue<int32_t>();
+            newPairs[i].transFallbackEnc = reader.ReadValue<int32_t>();
+            for (size_t j=0; j < 2; ++j) {
+                file_stamp stamp;
+                stamp.size = reader.ReadValue<uint64_t>();
+                stamp.modified = reader.ReadValue<int64_t>();
+                newStamps.push_back(stamp);
+            }
+        }
+        reader.Advance((8 - (reader.pos - data) % 8) % 8);
+        const uint64_t blockSize = reader.ReadValue<uint64_t>();
+        if (blockSize != static_cast<uint64_t>(reader.end - reader.pos))
+            throw runtime_error(translate("Translation memory file is invalid."));
+
+        index.Attach(reader.pos, blockSize);
+        pairs.swap(newPairs);
+        stamps.swap(newStamps);
+        file.swap(newFile);
+        region.swap(newRegion);
+    }
+
+    bool TranslationMemory::IsOutdated() const {
+        try {
+            for (size_t i=0, max=pairs.size(); i < max; ++i) {
+                const file_stamp source = GetFileStamp(pairs[i].source);
+                const file_stamp trans = GetFileStamp(pairs[i].trans);
+                if (source.size != stamps[2 * i].size || source.modified != stamps[2 * i].modified
+                    || trans.size != stamps[2 * i + 1].size || trans.modified != stamps[2 * i + 1].modified)
+                    return true;
+            }
+        } catch (boost::filesystem::filesystem_error& /*e*/) {
+            return true;  //A file is missing or can't be read.
+        }
+        return false;
+    }
+
+    const std::vector<vocab_pair>& TranslationMemory::GetVocabPairs() const {
+        return pairs;
+    }
+
+    FuzzyIndex& TranslationMemory::GetIndex() {
+        return index;
+    }
+
+    const FuzzyIndex& TranslationMemory::GetIndex() const {
+        return index;
+    }
+
+    TranslationMemory::file_stamp TranslationMemory::GetFileStamp(const std::string& path) {
+        file_stamp stamp;
+        stamp.size = boost::filesystem::file_size(path);
+        stamp.modified = boost::filesystem::last_write_time(path);
+        return stamp;
+    }
+}
@@ -0,0 +1,92 @@
+/*  StrEdit
+
+    A minimalist TES V: Skyrim string table editor designed for mod translators.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of StrEdit.
+
+    StrEdit is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    StrEdit is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with StrEdit.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __STREDIT_TRANSMEM_H__
+#define __STREDIT_TRANSMEM_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "fuzzy.h"
+#include "progress.h"
+#include "threadpool.h"
+
+namespace stredit {
+    struct vocab_pair {
+        std::string source;
+        std::string trans;
+        int sourceFallbackEnc;
+        int transFallbackEnc;
+    };
+
+    bool operator == (const vocab_pair& first, const vocab_pair& second);
+
+    //A vocabulary built from pairs of strings files, indexed for fuzzy matching.
+    //It can be saved as a translation memory file, which is memory-mapped and
+    //used in place when loaded, so loading it is much quicker than reading
+    //the strings files again. The file records the size and modification
+    //time of each strings file, so that outdated files can be rebuilt.
+    class TranslationMemory : private boost::noncopyable {
+    public:
+        //Reads the strings of each pair and indexes them. Later pairs don't
+        //replace the strings of earlier ones.
+        void Build(const std::vector<vocab_pair>& pairs, ProgressState * progress, const CancelToken * cancel = NULL);
+
+        //Writes the translation memory to path, replacing any existing file.
+        void Save(const std::string& path) const;
+
+        //Maps the translation memory file at path. If it can't be loaded, a
+        //runtime_error is thrown and the current contents are kept.
+        void Load(const std::string& path);
+
+        //Whether any of the strings files have changed since the translation
+        //memory was built.
+        bool IsOutdated() const;
+
+        const std::vector<vocab_pair>& GetVocabPairs() const;
+
+        FuzzyIndex& GetIndex();
+        const FuzzyIndex& GetIndex() const;
+    private:
+        struct file_stamp {
+            uint64_t size;
+            int64_t modified;
+        };
+
+        static file_stamp GetFileStamp(const std::string& path);
+
+        std::vector<vocab_pair> pairs;
+        std::vector<file_stamp> stamps;  //The source then translation file of each pair.
+        FuzzyIndex index;
+
+        //Hold the index's memory block for loaded files.
+        boost::interprocess::file_mapping file;
+        boost::interprocess::mapped_region region;
+    };
+}
+
+#endif
@@ -22,12 +22,15 @@
 */
 
 #include "ui.h"
+#include "progress.h"
 
 #include <stdexcept>
 #include <algorithm>
 #include <boost/locale.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
 #include <wx/aboutdlg.h>
 #include <wx/msgdlg.h>
 #include <wx/splitter.h>
@@ -46,21 +49,28 @@ BEGIN_EVENT_TABLE ( MainFrame, wxFrame )
     EVT_MENU ( MENU_ExportXML , MainFrame::OnExportXML )
 
     EVT_LIST_ITEM_SELECTED ( LIST_Strings , MainFrame::OnStringSelect )
+    EVT_LIST_ITEM_ACTIVATED ( LIST_Suggestions , MainFrame::OnSuggestionActivate )
 
     EVT_TEXT_ENTER ( SEARCH_Strings, MainFrame::OnStringFilter )
     EVT_SEARCHCTRL_SEARCH_BTN ( SEARCH_Strings , MainFrame::OnStringFilter )
     EVT_SEARCHCTRL_CANCEL_BTN ( SEARCH_Strings , MainFrame::OnStringFilterCancel )
+    EVT_TEXT ( SEARCH_Strings , MainFrame::OnStringFilterChange )
+    EVT_CHOICE ( CHOICE_SearchColumn , MainFrame::OnSearchColumnChange )
+    EVT_TIMER ( TIMER_Filter , MainFrame::OnFilterTimer )
+    EVT_TIMER ( TIMER_FilterPoll , MainFrame::OnFilterPoll )
 
     EVT_CHAR_HOOK ( MainFrame::OnKeyDown )
 END_EVENT_TABLE()
 
 BEGIN_EVENT_TABLE ( VirtualList, wxListCtrl )
     EVT_CLOSE ( VirtualList::OnClose )
+    EVT_LIST_COL_CLICK ( LIST_Strings , VirtualList::OnColumnClick )
 END_EVENT_TABLE()
 
 BEGIN_EVENT_TABLE ( VocabDialog, wxDialog )
     EVT_BUTTON ( wxID_ADD , VocabDialog::OnAddPair )
     EVT_BUTTON ( wxID_REMOVE , VocabDialog::OnRemovePair )
+    EVT_FILEPICKER_CHANGED ( PICKER_TranslationMemory , VocabDialog::OnTranslationMemoryChanged )
 END_EVENT_TABLE()
 
 IMPLEMENT_APP(StrEditApp)
@@ -68,14 +78,24 @@ IMPLEMENT_APP(StrEditApp)
 using namespace std;
 using namespace stredit;
 
+//How long typing in the search box must pause for before the strings are
+//filtered, and how often the filter's search is then checked on, in ms.
+static const int filter_delay = 250;
+static const int filter_poll_interval = 20;
+
+//How many cells' text the string list keeps, which is enough for several
+//screens of rows, and how many bytes of a string's first line are shown.
+static const size_t item_text_cache_size = 4096;
+static const size_t preview_length = 256;
+
 namespace stredit {
     //UI helper functions.
     wxString translate(const string str) {
         return wxString(boost::locale::translate(str).str().c_str(), wxConvUTF8);
     }
 
-    wxString FromUTF8(const string str) {
-        return wxString(str.c_str(), wxConvUTF8);
+    wxString FromUTF8(const boost::string_ref str) {
+        return wxString(str.data(), wxConvUTF8, str.length());
     }
 
     wxString FromUTF8(const boost::format f) {
@@ -97,7 +117,154 @@ bool StrEditApp::OnInit() {
     return true;
 }
 
-VirtualList::VirtualList(wxWindow * parent, wxWindowID id) : wxListCtrl(parent, id, wxDefaultPosition, wxDefaultSize, wxLC_REPORT|wxLC_VIRTUAL), currentSelectionIndex(-1) {
+//Describes how far through its current stage an operation is, and if it has
+//made a start, how quickly it is going and roughly how long it has left.
+static wxString FormatProgress(const progress_info& info) {
+    const size_t done = min(info.done, info.total);
+    const double seconds = info.elapsed.total_milliseconds() / 1000.0;
+    if (done == 0 || seconds <= 0)
+        return FromUTF8(boost::format(boost::locale::translate("%1%\n%2% of %3%")) % info.message % done % info.total);
+
+    const double rate = done / seconds;
+    const int remaining = int((info.total - done) / rate + 0.5);
+    return FromUTF8(boost::format(boost::locale::translate("%1%\n%2% of %3% (%4% per second, about %5% seconds left)"))
+                    % info.message % done % info.total % int(rate + 0.5) % remaining);
+}
+
+//Runs a task on a background thread, refreshing the progress dialog from its
+//progress every 50ms until it finishes, however often the task advances it.
+//Cancelling the dialog cancels the token, and poll is called on this thread
+//after each refresh. Rethrows any exception the task threw.
+static void RunInBackground(const WorkStealingPool::task& t, wxProgressDialog& progDia, const ProgressState& progress, CancelToken& cancel,
+                            const boost::function<void ()>& poll = boost::function<void ()>()) {
+    WorkStealingPool pool(1);
+    pool.Submit(t);
+    while (!pool.Wait(boost::posix_time::milliseconds(50))) {
+        const progress_info info = progress.GetInfo();
+        bool keepGoing;
+        if (info.total == 0)
+            keepGoing = progDia.Pulse(FromUTF8(info.message));
+        else
+            keepGoing = progDia.Update(min<size_t>(info.done * 100 / info.total, 99), FormatProgress(info));
+        if (!keepGoing)
+            cancel.Cancel();
+        if (poll)
+            poll();
+    }
+}
+
+//Background tasks for MainFrame's operations. They only use the objects
+//passed to them, so the UI thread can keep handling events while they run.
+//The strings are copied out of the files, which are closed once they are read.
+static void OpenTask(const string sourcePath, const int sourceEnc, const string transPath, const int transEnc,
+                     StringTable * items, vector<uint32_t> * order, SearchIndex * searchIndex, const CancelToken * cancel) {
+    vector<string> paths(1, sourcePath);
+    vector<int> fallbackEncs(1, sourceEnc);
+    if (!transPath.empty()) {
+        paths.push_back(transPath);
+        fallbackEncs.push_back(transEnc);
+    }
+    boost::ptr_vector<StringsFile> files;
+    OpenStringsFiles(paths, fallbackEncs, files, cancel);
+
+    if (transPath.empty())
+        GetStrings(files[0], *items);
+    else
+        BuildStringData(files[0], files[1], *items);
+    SortStrings(*items, *order);
+    searchIndex->Build(*items);
+}
+
+static void ImportTask(const string path, StringTable * items, vector<uint32_t> * order, SearchIndex * searchIndex, const CancelToken * cancel) {
+    ImportAsXML(path, *items, cancel);
+    SortStrings(*items, *order);
+    searchIndex->Build(*items);
+}
+
+//Uses the translation memory file if it was built from the same vocabulary
+//files as they are now, otherwise builds the vocabulary and its index from
+//the files and saves them for next time. The translation memory can still be
+//used if saving it fails, so the error is output instead of thrown.
+static void VocabularyTask(const vector<vocab_pair> pairs, const string tmPath, TranslationMemory * tm, string * saveError,
+                           ProgressState * progress, const CancelToken * cancel) {
+    bool loaded = false;
+    if (!tmPath.empty() && boost::filesystem::exists(tmPath)) {
+        progress->Start(boost::locale::translate("Loading translation memory...").str(), 0);
+        try {
+            tm->Load(tmPath);
+            loaded = tm->GetVocabPairs() == pairs && !tm->IsOutdated();
+        } catch (runtime_error& /*e*/) {
+            //Rebuild it.
+        }
+    }
+    if (!loaded) {
+        tm->Build(pairs, progress, cancel);
+        if (!tmPath.empty()) {
+            try {
+                tm->Save(tmPath);
+            } catch (runtime_error& e) {
+                *saveError = e.what();
+            }
+        }
+    }
+}
+
+//Strings are shown up to their first line break, and long lines are cut
+//short at a character boundary, so that drawing a row of a book's text
+//doesn't convert all of it. Shortened strings end with an ellipsis.
+static wxString GetPreview(const boost::string_ref str) {
+    size_t length = min(str.find_first_of("\r\n"), str.length());
+    if (length > preview_length) {
+        length = preview_length;
+        while (length > 0 && (static_cast<unsigned char>(str[length]) & 0xC0) == 0x80)
+            --length;
+    }
+    if (length == str.length())
+        return FromUTF8(str);
+    return FromUTF8(str.substr(0, length)) + FromUTF8("\u2026");
+}
+
+ItemTextCache::ItemTextCache(const size_t capacity) : capacity(capacity) {}
+
+const wxString * ItemTextCache::Find(const size_t position, const long column) {
+    const boost::unordered_map<cell, list<entry>::iterator>::const_iterator it = index.find(cell(position, column));
+    if (it == index.end())
+        return NULL;
+    entries.splice(entries.begin(), entries, it->second);
+    return &it->second->second;
+}
+
+const wxString& ItemTextCache::Insert(const size_t position, const long column, const wxString& text) {
+    if (entries.size() >= capacity) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+    entries.push_front(entry(cell(position, column), text));
+    index[cell(position, column)] = entries.begin();
+    return entries.front().second;
+}
+
+void ItemTextCache::Erase(const size_t position) {
+    for (long column=0; column < 4; ++column) {
+        const boost::unordered_map<cell, list<entry>::iterator>::iterator it = index.find(cell(position, column));
+        if (it != index.end()) {
+            entries.erase(it->second);
+            index.erase(it);
+        }
+    }
+}
+
+void ItemTextCache::Clear() {
+    entries.clear();
+    index.clear();
+}
+
+static void MatchTask(const FuzzyIndex * vocabIndex, StringTable * untranslated, MatchCache * cache, const CancelToken * cancel,
+                      MatchedStrings * matched, ProgressState * progress, fuzzy_match_stats * stats) {
+    *stats = FuzzyMatchStrings(*vocabIndex, *untranslated, fuzzy_suggestion_count, cache, cancel, matched, progress);
+}
+
+VirtualList::VirtualList(wxWindow * parent, wxWindowID id) : wxListCtrl(parent, id, wxDefaultPosition, wxDefaultSize, wxLC_REPORT|wxLC_VIRTUAL), sortColumn(-1), sortAscending(true), translatedCount(0), fuzzyCount(0), editedCount(0), savedSize(0), savedTime(0), filterColumn(search_old), pendingColumn(search_old), currentSelectionIndex(-1), itemTextCache(item_text_cache_size) {
     attr = new wxListItemAttr();
 
     InsertColumn(0, translate("Fuzzy"));
@@ -106,28 +273,33 @@ VirtualList::VirtualList(wxWindow * parent, wxWindowID id) : wxListCtrl(parent,
     InsertColumn(3, translate("New String"));
 }
 
+//The text is cached by string position rather than row, so it stays valid
+//when the strings are sorted or filtered, and only needs to be dropped when
+//a string changes.
 wxString VirtualList::OnGetItemText(long item, long column) const {
-    if (!filter.empty())
-        item = filter[item];
+    item = GetStringPosition(item);
+
+    const wxString * cached = itemTextCache.Find(item, column);
+    if (cached != NULL)
+        return *cached;
 
     if (column == 0) {
-        if (internalData[item].fuzzy)
-            return FromUTF8("\u2713");
+        if (internalData.IsFuzzy(item))
+            return itemTextCache.Insert(item, column, FromUTF8("\u2713"));
         else
-            return "";
+            return itemTextCache.Insert(item, column, "");
     } else if (column == 1)
-        return wxString::Format(wxT("%i"), internalData[item].id);
+        return itemTextCache.Insert(item, column, wxString::Format(wxT("%i"), internalData.GetId(item)));
     else if (column == 2)
-        return FromUTF8(internalData[item].oldString);
+        return itemTextCache.Insert(item, column, GetPreview(internalData.GetOldString(item)));
     else
-        return FromUTF8(internalData[item].newString);
+        return itemTextCache.Insert(item, column, GetPreview(internalData.GetNewString(item)));
 }
 
 wxListItemAttr * VirtualList::OnGetItemAttr(long item) const {
-    if (!filter.empty())
-        item = filter[item];
+    item = GetStringPosition(item);
 
-    if (internalData[item].edited)
+    if (internalData.IsEdited(item))
         attr->SetTextColour(*wxBLUE);
     else
         attr->SetTextColour(*wxBLACK);
@@ -139,113 +311,255 @@ void VirtualList::OnClose(wxCloseEvent& event) {
     Destroy();
 }
 
-void VirtualList::SetItems(const wxString sourcePath, const int sourceEnc, const wxString transPath, const int transEnc) {
-    if (transPath.empty())
-        GetStrings(sourcePath.ToUTF8().data(), sourceEnc, internalData);
+//Clicking the column the strings are sorted by reverses their order.
+void VirtualList::OnColumnClick(wxListEvent& event) {
+    if (event.GetColumn() < 0)
+        return;
+    if (event.GetColumn() == sortColumn)
+        sortAscending = !sortAscending;
     else {
-        boost::unordered_map<uint32_t, std::string> sourceMap;
-        boost::unordered_map<uint32_t, std::string> transMap;
-        GetStrings(sourcePath.ToUTF8().data(), sourceEnc, sourceMap);
-        GetStrings(transPath.ToUTF8().data(), transEnc, transMap);
-        BuildStringData(sourceMap, transMap, internalData);
+        sortColumn = event.GetColumn();
+        sortAscending = true;
     }
+    SortItems();
+    UpdateColumnTitles();
+}
+
+void VirtualList::SetItems(StringTable& items, std::vector<uint32_t>& itemOrder, SearchIndex& index) {
+    searchWorker.Cancel();
+    internalData.swap(items);
+    order.swap(itemOrder);
+    searchIndex.swap(index);
+    savedPath.clear();
+    CountItems();
+    itemTextCache.Clear();
+    collationKeys.Clear();
+    sortColumn = -1;
+    UpdateColumnTitles();
 
-    sort(internalData.begin(), internalData.end(), compare_old_new);
     size_t listSize = internalData.size();
     SetItemCount(listSize);
     RefreshItems(0, listSize - 1);
     //Reset everything.
+    filterText.clear();
     filter.clear();
+    pendingText.clear();
     currentSelectionIndex = -1;
 }
 
-void VirtualList::SetItems(const wxString xmlPath) {
-    ImportAsXML(xmlPath.ToUTF8().data(), internalData);
+void VirtualList::GetUntranslatedItems(StringTable& untranslated, std::vector<size_t>& positions) const {
+    untranslated.Clear();
+    positions.clear();
+    for (size_t i=0, max=internalData.size(); i < max; ++i) {
+        if (!internalData.HasNewString(i)) {
+            untranslated.Append(internalData.GetId(i), internalData.GetOldString(i));
+            positions.push_back(i);
+        }
+    }
+}
 
-    sort(internalData.begin(), internalData.end(), compare_old_new);
-    size_t listSize = internalData.size();
-    SetItemCount(listSize);
-    RefreshItems(0, listSize - 1);
-    //Reset everything.
-    filter.clear();
-    currentSelectionIndex = -1;
+void VirtualList::SetMatchedItems(const std::vector<size_t>& positions, MatchedStrings& matched) {
+    vector<matched_string> matchedStrings;
+    matched.Take(matchedStrings);
+    if (matchedStrings.empty())
+        return;
+
+    const bool filtering = searchWorker.IsPending();
+    searchWorker.Cancel();
+
+    for (vector<matched_string>::const_iterator it=matchedStrings.begin(), endIt=matchedStrings.end(); it != endIt; ++it) {
+        const size_t i = positions[it->position];
+        UncountItem(i);
+        internalData.SetNewString(i, it->newString);
+        internalData.SetFuzzy(i, it->fuzzy);
+        internalData.SetSuggestions(i, it->suggestions);
+        CountItem(i);
+        searchIndex.Update(i, it->newString);
+        collationKeys.Invalidate(i);
+        itemTextCache.Erase(i);
+    }
+    savedPath.clear();  //Matched strings aren't flagged as edited.
+    if (filtering)
+        StartFilter();
+    Refresh();
 }
 
-void VirtualList::FuzzyTranslate(const boost::unordered_map<std::string, std::string>& stringMap, wxProgressDialog * pd) {
-    FuzzyMatchStrings(stringMap, internalData, pd);
+//Sorting only changes the order the strings are shown in, so the search
+//index and any search running are still valid for them. The selected
+//string stays selected in its new row.
+void VirtualList::SortItems() {
+    const long selectedRow = GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+    if (sortColumn == -1)
+        SortStrings(internalData, order);
+    else
+        SortStrings(internalData, static_cast<sort_column>(sortColumn), sortAscending, collationKeys, order);
+    if (!filterText.empty())
+        OrderFilter();
+    RefreshItems(0, GetItemCount() - 1);
+
+    if (selectedRow != -1 && currentSelectionIndex != -1) {
+        const long row = GetStringRow(currentSelectionIndex);
+        SetItemState(selectedRow, 0, wxLIST_STATE_SELECTED|wxLIST_STATE_FOCUSED);
+        if (row != -1) {
+            SetItemState(row, wxLIST_STATE_SELECTED|wxLIST_STATE_FOCUSED, wxLIST_STATE_SELECTED|wxLIST_STATE_FOCUSED);
+            EnsureVisible(row);
+        }
+    }
+}
 
-    sort(internalData.begin(), internalData.end(), compare_old_new);
-    RefreshItems(0, internalData.size() - 1);
+//The sorted column's title is marked with an arrow pointing in the
+//direction the strings are sorted in.
+void VirtualList::UpdateColumnTitles() {
+    const wxString titles[] = {
+        translate("Fuzzy"),
+        translate("ID"),
+        translate("Original String"),
+        translate("New String")
+    };
+    for (int i=0; i < 4; ++i) {
+        wxListItem column;
+        column.SetMask(wxLIST_MASK_TEXT);
+        if (i != sortColumn)
+            column.SetText(titles[i]);
+        else if (sortAscending)
+            column.SetText(titles[i] + FromUTF8(" \u25B2"));
+        else
+            column.SetText(titles[i] + FromUTF8(" \u25BC"));
+        SetColumn(i, column);
+    }
 }
 
 int VirtualList::GetTotalItemCount() const {
-    internalData.size();
+    return internalData.size();
 }
 
+//The filter holds the positions of the strings shown, so a filter that
+//matched nothing is empty, like no filter at all, but hides everything.
 int VirtualList::GetHiddenCount() const {
-    if (filter.empty())
+    if (filterText.empty())
         return 0;
     else
         return internalData.size() - filter.size();
 }
 
 int VirtualList::GetFuzzyCount() const {
-    int count = 0;
-    for (std::vector<str_data>::const_iterator it=internalData.begin(), endIt=internalData.end(); it != endIt; ++it) {
-        if (it->fuzzy)
-            ++count;
-    }
-    return count;
+    return fuzzyCount;
 }
 
 int VirtualList::GetTranslatedCount() const {
-    int count = 0;
-    for (std::vector<str_data>::const_iterator it=internalData.begin(), endIt=internalData.end(); it != endIt; ++it) {
-        if (!it->newString.empty())
-            ++count;
-    }
-    return count;
+    return translatedCount;
 }
 
-const std::vector<stredit::str_data>& VirtualList::GetItems() const {
+const StringTable& VirtualList::GetItems() const {
     return internalData;
 }
 
 bool VirtualList::IsContentEdited() const {
-    for (std::vector<str_data>::const_iterator it=internalData.begin(), endIt=internalData.end(); it != endIt; ++it) {
-        if (it->edited)
-            return true;
-    }
-    return false;
+    return editedCount != 0;
+}
+
+void VirtualList::SaveItems(const std::string& path, const CancelToken * cancel) const {
+    boost::system::error_code sizeEc, timeEc;
+    if (path != savedPath
+        || boost::filesystem::file_size(path, sizeEc) != savedSize || sizeEc
+        || boost::filesystem::last_write_time(path, timeEc) != savedTime || timeEc
+        || !UpdateStrings(path, internalData, cancel))
+        SetStrings(path, internalData, cancel);
+}
+
+void VirtualList::SetSaved(const std::string& path) {
+    boost::system::error_code sizeEc, timeEc;
+    ResetEditedFlags();
+    savedPath = path;
+    savedSize = boost::filesystem::file_size(path, sizeEc);
+    savedTime = boost::filesystem::last_write_time(path, timeEc);
+    if (sizeEc || timeEc)
+        savedPath.clear();
 }
 
 void VirtualList::ResetEditedFlags() {
-    for (std::vector<str_data>::iterator it=internalData.begin(), endIt=internalData.end(); it != endIt; ++it) {
-        if (it->edited)
-            it->edited = false;
-    }
+    if (editedCount == 0)
+        return;
+    for (size_t i=0, max=internalData.size(); i < max; ++i)
+        internalData.SetEdited(i, false);
+    editedCount = 0;
+    savedPath.clear();  //The saved file no longer has all the edits.
 }
 
-void VirtualList::ApplyFilter(const wxString str) {
-    filter.clear();
-    size_t itemCount = 0;
-    if (!str.empty()) {
-        string filterStr = boost::locale::fold_case(str.ToUTF8().data());
-        for (size_t i=0, max=internalData.size(); i < max; ++i) {
-            if (boost::contains(boost::locale::fold_case(internalData[i].oldString), filterStr))
-                filter.push_back(i);
-        }
-        itemCount = filter.size();
-    } else {
-        itemCount = internalData.size();
+void VirtualList::ApplyFilter(const wxString str, const search_column column) {
+    pendingText = boost::locale::fold_case(string(str.ToUTF8().data()));
+    pendingColumn = column;
+    if (!pendingText.empty()) {
+        StartFilter();
+        return;
     }
 
-    SetItemCount(itemCount);
-    RefreshItems(0, itemCount - 1);
+    searchWorker.Cancel();
+    filter.clear();
+    filterText.clear();
+    SetItemCount(internalData.size());
+    RefreshItems(0, internalData.size() - 1);
+}
+
+//The result is swapped in whole, so the list never shows a partial one.
+bool VirtualList::UpdateFilter() {
+    if (!searchWorker.TakeResult(filter))
+        return false;
+    filterText = pendingText;
+    filterColumn = pendingColumn;
+    OrderFilter();
+
+    SetItemCount(filter.size());
+    RefreshItems(0, filter.size() - 1);
+    return true;
+}
+
+bool VirtualList::IsFiltering() const {
+    return searchWorker.IsPending();
+}
+
+//Strings that contain the new text also contain any part of it, so if it
+//contains the text last filtered on, only the strings shown need searching.
+void VirtualList::StartFilter() {
+    const bool narrow = !filterText.empty() && pendingColumn == filterColumn && boost::contains(pendingText, filterText);
+    searchWorker.Start(searchIndex, pendingText, pendingColumn, narrow ? &filter : NULL);
 }
 
 bool VirtualList::IsFiltered() const {
-    return !filter.empty();
+    return !filterText.empty();
+}
+
+size_t VirtualList::GetStringPosition(const long row) const {
+    if (filterText.empty())
+        return order[row];
+    else
+        return filter[row];
+}
+
+long VirtualList::GetStringRow(const size_t position) const {
+    if (filterText.empty()) {
+        vector<uint32_t>::const_iterator it = find(order.begin(), order.end(), static_cast<uint32_t>(position));
+        if (it != order.end())
+            return it - order.begin();
+    } else {
+        vector<int>::const_iterator it = find(filter.begin(), filter.end(), static_cast<int>(position));
+        if (it != filter.end())
+            return it - filter.begin();
+    }
+    return -1;
+}
+
+//Searches output positions in the order they are in the string list, so
+//the filter is put in the order the strings are shown in.
+void VirtualList::OrderFilter() {
+    vector<bool> shown(internalData.size(), false);
+    for (vector<int>::const_iterator it=filter.begin(), endIt=filter.end(); it != endIt; ++it)
+        shown[*it] = true;
+    filter.clear();
+    for (vector<uint32_t>::const_iterator it=order.begin(), endIt=order.end(); it != endIt; ++it) {
+        if (shown[*it])
+            filter.push_back(*it);
+    }
 }
 
 void VirtualList::UpdateSelectedItem(const wxString str) {
@@ -253,27 +567,60 @@ void VirtualList::UpdateSelectedItem(const wxString str) {
 
         string newStr = str.ToUTF8().data();
 
-        if (internalData[currentSelectionIndex].newString != newStr) {
-            internalData[currentSelectionIndex].newString = newStr;
-            internalData[currentSelectionIndex].edited = true;
-            internalData[currentSelectionIndex].fuzzy = false;
-            RefreshItem(currentSelectionIndex);
+        if (internalData.GetNewString(currentSelectionIndex) != newStr) {
+            UncountItem(currentSelectionIndex);
+            internalData.SetNewString(currentSelectionIndex, newStr);
+            internalData.SetEdited(currentSelectionIndex, true);
+            internalData.SetFuzzy(currentSelectionIndex, false);
+            CountItem(currentSelectionIndex);
+
+            const bool filtering = searchWorker.IsPending();
+            searchWorker.Cancel();
+            searchIndex.Update(currentSelectionIndex, newStr);
+            collationKeys.Invalidate(currentSelectionIndex);
+            itemTextCache.Erase(currentSelectionIndex);
+            if (filtering)
+                StartFilter();
+            Refresh();
         }
     }
 }
 
+void VirtualList::CountItem(const size_t i) {
+    if (internalData.HasNewString(i))
+        ++translatedCount;
+    if (internalData.IsFuzzy(i))
+        ++fuzzyCount;
+    if (internalData.IsEdited(i))
+        ++editedCount;
+}
+
+void VirtualList::UncountItem(const size_t i) {
+    if (internalData.HasNewString(i))
+        --translatedCount;
+    if (internalData.IsFuzzy(i))
+        --fuzzyCount;
+    if (internalData.IsEdited(i))
+        --editedCount;
+}
+
+void VirtualList::CountItems() {
+    translatedCount = 0;
+    fuzzyCount = 0;
+    editedCount = 0;
+    for (size_t i=0, max=internalData.size(); i < max; ++i)
+        CountItem(i);
+}
+
 void VirtualList::SetSelectedIndex(const int i) {
-    if (filter.empty())
-        currentSelectionIndex = i;
-    else
-        currentSelectionIndex = filter[i];
+    currentSelectionIndex = GetStringPosition(i);
 }
 
-str_data VirtualList::GetSelectedItem() const {
-    return internalData[currentSelectionIndex];
+size_t VirtualList::GetSelectedPosition() const {
+    return currentSelectionIndex;
 }
 
-MainFrame::MainFrame(const wxChar *title) : wxFrame(NULL, wxID_ANY, title, wxDefaultPosition, wxDefaultSize), stringsEdited(false) {
+MainFrame::MainFrame(const wxChar *title) : wxFrame(NULL, wxID_ANY, title, wxDefaultPosition, wxDefaultSize), filterTimer(this, TIMER_Filter), filterPollTimer(this, TIMER_FilterPoll), stringsEdited(false) {
     //Set up menu bar first.
     wxMenuBar * MenuBar = new wxMenuBar();
     // File Menu
@@ -304,20 +651,37 @@ MainFrame::MainFrame(const wxChar *title) : wxFrame(NULL, wxID_ANY, title, wxDef
 
     searchBox = new wxSearchCtrl(topPanel, SEARCH_Strings, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxTE_PROCESS_ENTER);
 
+    wxString searchColumns[] = {
+        translate("Original strings"),
+        translate("New strings"),
+        translate("Both")
+    };
+    searchColumnChoice = new wxChoice(topPanel, CHOICE_SearchColumn, wxDefaultPosition, wxDefaultSize, 3, searchColumns);
+    searchColumnChoice->SetSelection(0);
+
     stringList = new VirtualList(topPanel, LIST_Strings);
 
     originalTextBox = new wxTextCtrl(bottomPanel, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxTE_MULTILINE | wxTE_READONLY);
     newTextBox = new wxTextCtrl(bottomPanel, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxTE_MULTILINE);
 
+    suggestionList = new wxListCtrl(bottomPanel, LIST_Suggestions, wxDefaultPosition, wxDefaultSize, wxLC_REPORT|wxLC_SINGLE_SEL);
+    suggestionList->AppendColumn(translate("Similarity"));
+    suggestionList->AppendColumn(translate("Source"));
+    suggestionList->AppendColumn(translate("Translation"));
+
     //Set up the sizers.
     wxBoxSizer * bigBox = new wxBoxSizer(wxVERTICAL);
     wxBoxSizer * topSizer = new wxBoxSizer(wxVERTICAL);
+    wxBoxSizer * searchSizer = new wxBoxSizer(wxHORIZONTAL);
     wxBoxSizer * bottomSizer = new wxBoxSizer(wxVERTICAL);
 
-    topSizer->Add(searchBox, 0, wxEXPAND);
+    searchSizer->Add(searchBox, 1, wxEXPAND|wxRIGHT, 5);
+    searchSizer->Add(searchColumnChoice, 0, wxEXPAND);
+    topSizer->Add(searchSizer, 0, wxEXPAND);
     topSizer->Add(stringList, 1, wxEXPAND);
     bottomSizer->Add(originalTextBox, 1, wxEXPAND|wxBOTTOM, 5);
-    bottomSizer->Add(newTextBox, 1, wxEXPAND);
+    bottomSizer->Add(newTextBox, 1, wxEXPAND|wxBOTTOM, 5);
+    bottomSizer->Add(suggestionList, 1, wxEXPAND);
     bigBox->Add(splitter, 1, wxEXPAND|wxALL, 5);
 
     //Now set the layout and misc. elements.
@@ -349,12 +713,23 @@ void MainFrame::OnOpenFile(wxCommandEvent& event) {
         return;
     }
 
-    wxProgressDialog progDia(translate("StrEdit: Working"), translate("Opening file..."), 100, this, wxPD_APP_MODAL);
+    wxProgressDialog progDia(translate("StrEdit: Working"), translate("Opening file..."), 100, this, wxPD_APP_MODAL|wxPD_CAN_ABORT);
     progDia.SetIcon(wxICON(MAINICON));
     progDia.Pulse();
+    ProgressState progress;
+    CancelToken cancel;
+    StringTable items;
+    vector<uint32_t> order;
+    SearchIndex searchIndex;
     try {
-        stringList->SetItems(od.GetSourcePath(), od.GetSourceFallbackEnc(), od.GetTransPath(), od.GetTransFallbackEnc());
-   } catch (runtime_error& e) {
+        RunInBackground(boost::bind(OpenTask,
+                                    string(od.GetSourcePath().ToUTF8().data()), od.GetSourceFallbackEnc(),
+                                    string(od.GetTransPath().ToUTF8().data()), od.GetTransFallbackEnc(),
+                                    &items, &order, &searchIndex, &cancel),
+                        progDia, progress, cancel);
+    } catch (operation_cancelled& /*e*/) {
+        return;
+    } catch (runtime_error& e) {
         wxMessageBox(
             FromUTF8(e.what()),
             translate("StrEdit: Error"),
@@ -362,7 +737,7 @@ void MainFrame::OnOpenFile(wxCommandEvent& event) {
             this);
         return;
     }
-    progDia.Pulse();
+    stringList->SetItems(items, order, searchIndex);
     //Reset everything.
     Reset();
     filePath = od.GetTransPath();
@@ -389,28 +764,96 @@ void MainFrame::OnMachineTranslate(wxCommandEvent& event) {
     if (vd.ShowModal() != wxID_OK)
         return;
 
-    //Now build up vocab string pair map.
-    wxProgressDialog progDia(translate("StrEdit: Working"), translate("Building Vocabulary..."), 100, this, wxPD_APP_MODAL|wxPD_ELAPSED_TIME);
+    wxProgressDialog progDia(translate("StrEdit: Working"), translate("Building Vocabulary..."), 100, this, wxPD_APP_MODAL|wxPD_ELAPSED_TIME|wxPD_CAN_ABORT);
     progDia.SetIcon(wxICON(MAINICON));
     progDia.Pulse();
     std::vector<stredit::vocab_pair> pairs = vd.GetVocabPairs();
-    boost::unordered_map<std::string, std::string> stringMap;
-    for (int i=0, max=pairs.size(); i < max; ++i) {
-        boost::unordered_map<uint32_t, std::string> sourceMap;
-        boost::unordered_map<uint32_t, std::string> transMap;
-        GetStrings(pairs[i].source, pairs[i].sourceFallbackEnc, sourceMap);
-        GetStrings(pairs[i].trans, pairs[i].transFallbackEnc, transMap);
-        BuildStringPairs(sourceMap, transMap, stringMap);
-        progDia.Pulse();
+    std::string tmPath = vd.GetTranslationMemoryPath().ToUTF8().data();
+
+    ProgressState progress;
+    CancelToken cancel;
+    TranslationMemory tm;
+    string saveError;
+    try {
+        RunInBackground(boost::bind(VocabularyTask, pairs, tmPath, &tm, &saveError, &progress, &cancel),
+                        progDia, progress, cancel);
+    } catch (operation_cancelled& /*e*/) {
+        return;
+    } catch (runtime_error& e) {
+        wxMessageBox(
+            FromUTF8(e.what()),
+            translate("StrEdit: Error"),
+            wxOK | wxICON_ERROR,
+            this);
+        return;
     }
+    if (!saveError.empty())
+        wxMessageBox(
+            FromUTF8(saveError),
+            translate("StrEdit: Error"),
+            wxOK | wxICON_ERROR,
+            this);
+
+    FuzzyIndex& vocabIndex = tm.GetIndex();
+    if (vd.UseApproximateMatching())
+        vocabIndex.SetSearchMode(FuzzyIndex::approximate_search);
 
     //Now fuzzy match to string list.
-    progDia.Update(0, translate("Translating strings..."));
-    stringList->FuzzyTranslate(stringMap, &progDia);
+    //Matches are cached alongside the translation memory file, so they can
+    //be reused until it changes. The cache only saves time, so any problem
+    //with it just means that strings get searched for instead.
+    MatchCache cache;
+    MatchCache * cachePtr = NULL;
+    if (!tmPath.empty()) {
+        try {
+            cache.Open(tmPath + ".cache", vocabIndex.GetFingerprint());
+            cachePtr = &cache;
+        } catch (runtime_error& /*e*/) {}
+    }
+
+    //Matched strings are shown in the list while the rest are still being
+    //matched, and those already matched are kept if it's cancelled.
+    StringTable untranslated;
+    vector<size_t> positions;
+    stringList->GetUntranslatedItems(untranslated, positions);
+    MatchedStrings matched;
+    fuzzy_match_stats stats;
+    try {
+        RunInBackground(boost::bind(MatchTask, &vocabIndex, &untranslated, cachePtr, &cancel, &matched, &progress, &stats),
+                        progDia, progress, cancel,
+                        boost::bind(&VirtualList::SetMatchedItems, stringList, boost::cref(positions), boost::ref(matched)));
+    } catch (runtime_error& e) {  //Only thrown if a worker thread couldn't be started.
+        wxMessageBox(
+            FromUTF8(e.what()),
+            translate("StrEdit: Error"),
+            wxOK | wxICON_ERROR,
+            this);
+    }
+    stringList->SetMatchedItems(positions, matched);
+    stringList->SortItems();
     UpdateStatus();
+
+    if (cachePtr != NULL) {
+        try {
+            cache.Flush();
+        } catch (runtime_error& /*e*/) {}
+    }
+
+    if (cancel.IsCancelled())
+        return;
+
+    //Report how many searches were saved by only matching each distinct string once.
+    int savedPercent = 0;
+    if (stats.untranslated > 0)
+        savedPercent = int(float(stats.untranslated - stats.unique) / stats.untranslated * 100);
+    wxMessageBox(
+        wxString::Format(translate("Translated %i strings, of which %i were unique (%i%% duplicates) and %i had cached matches."), int(stats.untranslated), int(stats.unique), savedPercent, int(stats.cached)),
+        translate("StrEdit: Machine Translation"),
+        wxOK | wxICON_INFORMATION,
+        this);
 }
 
-void MainFrame::SaveFile() {
+bool MainFrame::SaveFile() {
     if (filePath.empty()) {
         //Display file picker dialog.
         wxFileDialog saveFileDialog(this, translate("Save As"), wxEmptyString, wxEmptyString,
@@ -420,26 +863,31 @@ void MainFrame::SaveFile() {
         saveFileDialog.SetIcon(wxICON(MAINICON));
 
         if (saveFileDialog.ShowModal() == wxID_CANCEL)
-            return;
+            return false;
 
         filePath = saveFileDialog.GetPath().ToUTF8();
     }
 
-    wxProgressDialog progDia(translate("StrEdit: Working"), translate("Saving file..."), 100, this);
+    wxProgressDialog progDia(translate("StrEdit: Working"), translate("Saving file..."), 100, this, wxPD_APP_MODAL|wxPD_CAN_ABORT);
     progDia.SetIcon(wxICON(MAINICON));
     progDia.Pulse();
+    ProgressState progress;
+    CancelToken cancel;
     try {
-        SetStrings(filePath, stringList->GetItems());
+        RunInBackground(boost::bind(&VirtualList::SaveItems, stringList, filePath, &cancel),
+                        progDia, progress, cancel);
+    } catch (operation_cancelled& /*e*/) {
+        return false;
     } catch (exception& e) {  //bad_alloc or runtime_error.
         wxMessageBox(
             FromUTF8(e.what()),
             translate("StrEdit: Error"),
             wxOK | wxICON_ERROR,
             this);
-        return;
+        return false;
     }
-
-    stringList->ResetEditedFlags();
+    stringList->SetSaved(filePath);
+    return true;
 }
 
 void MainFrame::OnQuit(wxCommandEvent& event) {
@@ -456,8 +904,8 @@ void MainFrame::OnClose(wxCloseEvent& event) {
 
         if (ret == wxID_CANCEL)
             return;
-        else if (ret == wxID_YES)
-            SaveFile();
+        else if (ret == wxID_YES && !SaveFile())
+            return;
     }
 
     Destroy();
@@ -503,11 +951,19 @@ void MainFrame::OnImportXML(wxCommandEvent& event) {
     if (fd.ShowModal() != wxID_OK)
         return;
 
-    wxProgressDialog progDia(translate("StrEdit: Working"), translate("Importing strings..."), 100, this, wxPD_APP_MODAL);
+    wxProgressDialog progDia(translate("StrEdit: Working"), translate("Importing strings..."), 100, this, wxPD_APP_MODAL|wxPD_CAN_ABORT);
     progDia.SetIcon(wxICON(MAINICON));
     progDia.Pulse();
+    ProgressState progress;
+    CancelToken cancel;
+    StringTable items;
+    vector<uint32_t> order;
+    SearchIndex searchIndex;
     try {
-        stringList->SetItems(fd.GetPath());
+        RunInBackground(boost::bind(ImportTask, string(fd.GetPath().ToUTF8().data()), &items, &order, &searchIndex, &cancel),
+                        progDia, progress, cancel);
+    } catch (operation_cancelled& /*e*/) {
+        return;
     } catch (runtime_error& e) {
         wxMessageBox(
             FromUTF8(e.what()),
@@ -516,7 +972,7 @@ void MainFrame::OnImportXML(wxCommandEvent& event) {
             this);
         return;
     }
-    progDia.Pulse();
+    stringList->SetItems(items, order, searchIndex);
     Reset();
     UpdateStatus();
     SetTitle("StrEdit");
@@ -528,10 +984,24 @@ void MainFrame::OnExportXML(wxCommandEvent& event) {
     if (fd.ShowModal() != wxID_OK)
         return;
 
-    wxProgressDialog progDia(translate("StrEdit: Working"), translate("Exporting strings..."), 100, this, wxPD_APP_MODAL);
+    wxProgressDialog progDia(translate("StrEdit: Working"), translate("Exporting strings..."), 100, this, wxPD_APP_MODAL|wxPD_CAN_ABORT);
     progDia.SetIcon(wxICON(MAINICON));
     progDia.Pulse();
-    ExportAsXML(fd.GetPath().ToUTF8().data(), stringList->GetItems());
+    ProgressState progress;
+    CancelToken cancel;
+    try {
+        RunInBackground(boost::bind(ExportAsXML, string(fd.GetPath().ToUTF8().data()), boost::cref(stringList->GetItems()), &cancel),
+                        progDia, progress, cancel);
+    } catch (operation_cancelled& /*e*/) {
+        return;
+    } catch (runtime_error& e) {
+        wxMessageBox(
+            FromUTF8(e.what()),
+            translate("StrEdit: Error"),
+            wxOK | wxICON_ERROR,
+            this);
+        return;
+    }
 
     stringList->ResetEditedFlags();
 }
@@ -542,30 +1012,81 @@ void MainFrame::OnStringSelect(wxListEvent& event) {
 
     stringList->SetSelectedIndex(event.GetIndex());
 
-    str_data data = stringList->GetSelectedItem();
+    const StringTable& items = stringList->GetItems();
+    const size_t position = stringList->GetSelectedPosition();
 
-    originalTextBox->SetValue(FromUTF8(data.oldString));
-    newTextBox->SetValue(FromUTF8(data.newString));
+    originalTextBox->SetValue(FromUTF8(items.GetOldString(position)));
+    newTextBox->SetValue(FromUTF8(items.GetNewString(position)));
+
+    //List the closest vocabulary matches found during machine translation.
+    suggestionList->DeleteAllItems();
+    const vector<fuzzy_suggestion>& suggestions = items.GetSuggestions(position);
+    for (size_t i=0, max=suggestions.size(); i < max; ++i) {
+        suggestionList->InsertItem(i, wxString::Format(wxT("%i%%"), int(suggestions[i].similarity * 100)));
+        suggestionList->SetItem(i, 1, FromUTF8(suggestions[i].source));
+        suggestionList->SetItem(i, 2, FromUTF8(suggestions[i].translation));
+    }
 
     UpdateStatus();
 }
 
+void MainFrame::OnSuggestionActivate(wxListEvent& event) {
+    //Use the suggestion's translation as the new string.
+    newTextBox->SetValue(suggestionList->GetItemText(event.GetIndex(), 2));
+    newTextBox->SetFocus();
+}
+
 void MainFrame::OnStringFilter(wxCommandEvent& event) {
-    if (event.GetString().empty()) {
-        OnStringFilterCancel(event);
-        return;
-    }
-    stringList->ApplyFilter(event.GetString());
-    searchBox->ShowCancelButton(true);
-    UpdateStatus();
+    //Don't wait for the typing delay.
+    filterTimer.Stop();
+    FilterStrings();
 }
 
 void MainFrame::OnStringFilterCancel(wxCommandEvent& event) {
-    stringList->ApplyFilter("");
+    filterTimer.Stop();
+    filterPollTimer.Stop();
+    stringList->ApplyFilter("", search_old);
     searchBox->ShowCancelButton(false);
     UpdateStatus();
 }
 
+void MainFrame::OnStringFilterChange(wxCommandEvent& event) {
+    //Restarting the timer on each change filters once typing pauses.
+    filterTimer.Start(filter_delay, wxTIMER_ONE_SHOT);
+}
+
+void MainFrame::OnFilterTimer(wxTimerEvent& event) {
+    FilterStrings();
+}
+
+void MainFrame::OnFilterPoll(wxTimerEvent& event) {
+    if (stringList->UpdateFilter())
+        UpdateStatus();
+    if (!stringList->IsFiltering())
+        filterPollTimer.Stop();
+}
+
+void MainFrame::OnSearchColumnChange(wxCommandEvent& event) {
+    //Reapply the filter to the newly chosen strings.
+    if (!searchBox->IsEmpty())
+        FilterStrings();
+}
+
+//Starts filtering the strings on the search box's text. The strings are
+//searched on another thread, and the list is updated when the poll timer
+//finds that the search has finished.
+void MainFrame::FilterStrings() {
+    if (searchBox->IsEmpty()) {
+        wxCommandEvent event;
+        OnStringFilterCancel(event);
+        return;
+    }
+    stringList->ApplyFilter(searchBox->GetValue(), static_cast<search_column>(searchColumnChoice->GetSelection()));
+    searchBox->ShowCancelButton(true);
+    if (!filterPollTimer.IsRunning())
+        filterPollTimer.Start(filter_poll_interval);
+}
+
 void MainFrame::OnKeyDown(wxKeyEvent& event) {
     if (event.AltDown() && event.GetKeyCode() == 'C') {
         //Fast copy/paste.
@@ -579,6 +1100,7 @@ void MainFrame::Reset() {
     searchBox->Clear();
     originalTextBox->Clear();
     newTextBox->Clear();
+    suggestionList->DeleteAllItems();
     filePath.clear();
     stringsEdited = false;
 }
@@ -665,6 +1187,7 @@ VocabDialog::VocabDialog(wxWindow * parent, wxWindowID id, const wxString& title
 
     wxBoxSizer * bigBox = new wxBoxSizer(wxVERTICAL);
     wxBoxSizer * buttonBox = new wxBoxSizer(wxHORIZONTAL);
+    wxBoxSizer * tmBox = new wxBoxSizer(wxHORIZONTAL);
 
     addButton = new wxButton(this, wxID_ADD);
     removeButton = new wxButton(this, wxID_REMOVE);
@@ -676,11 +1199,20 @@ VocabDialog::VocabDialog(wxWindow * parent, wxWindowID id, const wxString& title
     vocabPairList->AppendColumn(translate("Source Fallback Encoding"), wxLIST_FORMAT_LEFT, 0);
     vocabPairList->AppendColumn(translate("Translation Fallback Encoding"), wxLIST_FORMAT_LEFT, 0);
 
+    tmPicker = new wxFilePickerCtrl(this, PICKER_TranslationMemory, wxEmptyString, wxFileSelectorPromptStr, "Translation memory files (*.stm)|*.stm", wxDefaultPosition, wxDefaultSize, wxFLP_SAVE|wxFLP_USE_TEXTCTRL);
+
+    approximateBox = new wxCheckBox(this, wxID_ANY, translate("Fast approximate matching"));
+
     buttonBox->Add(addButton, 0, wxALL, 5);
     buttonBox->Add(removeButton, 0, wxALL, 5);
 
+    tmBox->Add(new wxStaticText(this, wxID_ANY, translate("Translation memory file")), 0, wxCENTER|wxALL, 5);
+    tmBox->Add(tmPicker, 1, wxEXPAND|wxALL, 5);
+
     bigBox->Add(vocabPairList, 1, wxEXPAND|wxALL, 5);
     bigBox->Add(buttonBox, 0, wxEXPAND|wxALL, 5);
+    bigBox->Add(tmBox, 0, wxEXPAND|wxALL, 5);
+    bigBox->Add(approximateBox, 0, wxEXPAND|wxALL, 5);
     bigBox->Add(buttons, 0, wxEXPAND|wxALL, 5);
 
     //Now set the layout and sizes.
@@ -710,11 +1242,12 @@ void VocabDialog::OnAddPair(wxCommandEvent& event) {
         return;
     }
 
-    int nextIndex = vocabPairList->GetItemCount();
-    vocabPairList->InsertItem(nextIndex, sourcePath);
-    vocabPairList->SetItem(nextIndex, 1, transPath);
-    vocabPairList->SetItem(nextIndex, 2, wxString::Format(wxT("%i"), sourceFallbackEnc));
-    vocabPairList->SetItem(nextIndex, 3, wxString::Format(wxT("%i"), transFallbackEnc));
+    vocab_pair pair;
+    pair.source = sourcePath;
+    pair.trans = transPath;
+    pair.sourceFallbackEnc = sourceFallbackEnc;
+    pair.transFallbackEnc = transFallbackEnc;
+    AddPair(pair);
 }
 
 void VocabDialog::OnRemovePair(wxCommandEvent& event) {
@@ -741,3 +1274,44 @@ vector<stredit::vocab_pair> VocabDialog::GetVocabPairs() const {
     }
     return pairs;
 }
+
+//Lists the vocabulary pairs that an existing translation memory file was
+//built from, so that it can be used or added to.
+void VocabDialog::OnTranslationMemoryChanged(wxFileDirPickerEvent& event) {
+    std::string path = event.GetPath().ToUTF8().data();
+    if (!boost::filesystem::exists(path))
+        return;
+
+    TranslationMemory tm;
+    try {
+        tm.Load(path);
+    } catch (runtime_error& e) {
+        wxMessageBox(
+            FromUTF8(e.what()),
+            translate("StrEdit: Error"),
+            wxOK | wxICON_ERROR,
+            this);
+        return;
+    }
+
+    vocabPairList->DeleteAllItems();
+    const vector<vocab_pair>& pairs = tm.GetVocabPairs();
+    for (vector<vocab_pair>::const_iterator it=pairs.begin(), endIt=pairs.end(); it != endIt; ++it)
+        AddPair(*it);
+}
+
+wxString VocabDialog::GetTranslationMemoryPath() const {
+    return tmPicker->GetPath();
+}
+
+bool VocabDialog::UseApproximateMatching() const {
+    return approximateBox->IsChecked();
+}
+
+void VocabDialog::AddPair(const vocab_pair& pair) {
+    int nextIndex = vocabPairList->GetItemCount();
+    vocabPairList->InsertItem(nextIndex, wxString(pair.source));
+    vocabPairList->SetItem(nextIndex, 1, wxString(pair.trans));
+    vocabPairList->SetItem(nextIndex, 2, wxString::Format(wxT("%i"), pair.sourceFallbackEnc));
+    vocabPairList->SetItem(nextIndex, 3, wxString::Format(wxT("%i"), pair.transFallbackEnc));
+}
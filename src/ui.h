@@ -25,9 +25,15 @@
 #define __STREDIT_UI_H__
 
 #include "backend.h"
+#include "searchindex.h"
+#include "transmem.h"
 
+#include <ctime>
+#include <list>
 #include <string>
+#include <utility>
 #include <boost/format.hpp>
+#include <boost/unordered_map.hpp>
 #include <wx/wxprec.h>
 #ifndef WX_PRECOMP
 #       include <wx/wx.h>
@@ -41,7 +47,7 @@
 //UI helper functions.
 namespace stredit {
     wxString translate(const std::string str);
-    wxString FromUTF8(const std::string str);
+    wxString FromUTF8(const boost::string_ref str);
     wxString FromUTF8(const boost::format f);
 }
 
@@ -49,10 +55,16 @@ namespace stredit {
 enum {
     //Main window.
     SEARCH_Strings = wxID_HIGHEST + 1, // declares an id which will be used to call our button
+    CHOICE_SearchColumn,
+    TIMER_Filter,
+    TIMER_FilterPoll,
     LIST_Strings,
+    LIST_Suggestions,
     MENU_MachineTranslate,
     MENU_ImportXML,
-    MENU_ExportXML
+    MENU_ExportXML,
+    //Vocabulary dialog.
+    PICKER_TranslationMemory
 };
 
 class StrEditApp : public wxApp {
@@ -60,42 +72,119 @@ public:
     bool OnInit();
 };
 
+//A bounded cache of the text shown in VirtualList's cells, keyed by string
+//position and column. When it is full, the least recently used text is
+//discarded to make room.
+class ItemTextCache {
+public:
+    explicit ItemTextCache(const size_t capacity);
+
+    //Returns NULL if the cell's text isn't cached.
+    const wxString * Find(const size_t position, const long column);
+    const wxString& Insert(const size_t position, const long column, const wxString& text);
+
+    //Discards the text of all the cells of a string.
+    void Erase(const size_t position);
+    void Clear();
+private:
+    typedef std::pair<size_t, long> cell;
+    typedef std::pair<cell, wxString> entry;
+
+    std::list<entry> entries;  //Most recently used first.
+    boost::unordered_map<cell, std::list<entry>::iterator> index;
+    size_t capacity;
+};
+
 class VirtualList : public wxListCtrl {
 public:
     VirtualList(wxWindow * parent, wxWindowID id);
 
     void OnClose(wxCloseEvent& event);
+    void OnColumnClick(wxListEvent& event);
 
-    void SetItems(const wxString sourcePath, const int sourceEnc,
-                  const wxString transPath = "", const int transEnc = 1252);
-    void SetItems(const wxString xmlPath);
+    //Replaces the strings with items, shown in the order of the positions in
+    //itemOrder, and a search index built from items. The arguments are left
+    //with the old contents.
+    void SetItems(stredit::StringTable& items, std::vector<uint32_t>& itemOrder, stredit::SearchIndex& index);
 
-    void FuzzyTranslate(const boost::unordered_map<std::string, std::string>& stringMap, wxProgressDialog * pd);
+    //Machine translation matches copies of the untranslated strings on
+    //another thread, and the matches are copied back as they are found. The
+    //positions are those of the copied strings in the list.
+    void GetUntranslatedItems(stredit::StringTable& untranslated, std::vector<size_t>& positions) const;
+    void SetMatchedItems(const std::vector<size_t>& positions, stredit::MatchedStrings& matched);
 
+    //Sorts the strings shown by the column last clicked, or if none has been
+    //since the strings were set, by their translation status.
+    void SortItems();
+
+    //The counts are kept up to date as the strings change, so are cheap.
     int GetTotalItemCount() const;
     int GetHiddenCount() const;
     int GetFuzzyCount() const;
     int GetTranslatedCount() const;
 
-    const std::vector<stredit::str_data>& GetItems() const;
+    const stredit::StringTable& GetItems() const;
+
+    //Saves the strings to the file at path. If path was last saved to and
+    //hasn't changed since, only the edited strings are written. This only
+    //reads the list, so can be done on another thread, and SetSaved() should
+    //be called once it's done to reset the edited flags.
+    void SaveItems(const std::string& path, const stredit::CancelToken * cancel) const;
+    void SetSaved(const std::string& path);
 
     bool IsContentEdited() const;
     void ResetEditedFlags();
 
-    void ApplyFilter(const wxString str);
+    //Filters the strings to those containing str. An empty str removes the
+    //filter at once, otherwise the strings are searched on another thread,
+    //and UpdateFilter() should be polled until IsFiltering() returns false.
+    //UpdateFilter() returns true when it has shown a new filter's strings.
+    void ApplyFilter(const wxString str, const stredit::search_column column);
+    bool UpdateFilter();
+    bool IsFiltering() const;
     bool IsFiltered() const;
 
     void UpdateSelectedItem(const wxString str);
     void SetSelectedIndex(const int i);
-    stredit::str_data GetSelectedItem() const;
+    size_t GetSelectedPosition() const;  //In GetItems().
 protected:
     wxString OnGetItemText(long item, long column) const;
     wxListItemAttr * OnGetItemAttr(long item) const;
     wxListItemAttr * attr;
 private:
-    std::vector<stredit::str_data> internalData;
-    std::vector<int> filter;
+    void StartFilter();
+    void OrderFilter();
+    void UpdateColumnTitles();
+    size_t GetStringPosition(const long row) const;  //In GetItems().
+    long GetStringRow(const size_t position) const;  //-1 if the string isn't shown.
+
+    //Adds or removes a string's contribution to the counts, before and
+    //after it is changed.
+    void CountItem(const size_t i);
+    void UncountItem(const size_t i);
+    void CountItems();
+
+    stredit::StringTable internalData;
+    std::vector<uint32_t> order;  //Positions of the strings, in the order they're shown.
+    stredit::CollationKeys collationKeys;
+    int sortColumn;             //-1 if the strings are sorted by translation status.
+    bool sortAscending;
+    size_t translatedCount;
+    size_t fuzzyCount;
+    size_t editedCount;
+
+    std::string savedPath;      //Holds the strings, except for edited ones.
+    uintmax_t savedSize;
+    std::time_t savedTime;
+    stredit::SearchIndex searchIndex;
+    std::string filterText;     //Case-folded.
+    stredit::search_column filterColumn;
+    std::vector<int> filter;    //Positions of the strings shown, in order.
+    std::string pendingText;    //Of the search running, case-folded.
+    stredit::search_column pendingColumn;
+    stredit::SearchWorker searchWorker;  //Declared after the index it searches, so it is destroyed first.
     int currentSelectionIndex;
+    mutable ItemTextCache itemTextCache;
 
     DECLARE_EVENT_TABLE()
 };
@@ -119,16 +208,26 @@ public:
     void OnStringDeselect(wxListEvent& event);
     void OnStringFilter(wxCommandEvent& event);
     void OnStringFilterCancel(wxCommandEvent& event);
+    void OnStringFilterChange(wxCommandEvent& event);
+    void OnFilterTimer(wxTimerEvent& event);
+    void OnFilterPoll(wxTimerEvent& event);
+    void OnSearchColumnChange(wxCommandEvent& event);
+    void OnSuggestionActivate(wxListEvent& event);
     void OnKeyDown(wxKeyEvent& event);
 
-    void SaveFile();
+    bool SaveFile();  //Returns false if the file wasn't saved.
+    void FilterStrings();
     void Reset();
     void UpdateStatus();
 private:
     VirtualList * stringList;
     wxSearchCtrl * searchBox;  //Could be used for filtering the string list.
+    wxChoice * searchColumnChoice;  //Which strings the search box filters on.
+    wxTimer filterTimer;      //Filters once typing in the search box pauses.
+    wxTimer filterPollTimer;  //Checks for the result while the filter's search runs.
     wxTextCtrl * originalTextBox;
     wxTextCtrl * newTextBox;
+    wxListCtrl * suggestionList;  //Closest vocabulary matches for the selected string.
 
     std::string filePath;
     bool stringsEdited;
@@ -152,27 +251,25 @@ private:
     wxChoice * transFallbackEncChoice;
 };
 
-namespace stredit {
-    struct vocab_pair {
-        std::string source;
-        std::string trans;
-        int sourceFallbackEnc;
-        int transFallbackEnc;
-    };
-}
-
 class VocabDialog : public wxDialog {
 public:
     VocabDialog(wxWindow * parent, wxWindowID id, const wxString& title);
 
     void OnAddPair(wxCommandEvent& event);
     void OnRemovePair(wxCommandEvent& event);
+    void OnTranslationMemoryChanged(wxFileDirPickerEvent& event);
 
     std::vector<stredit::vocab_pair> GetVocabPairs() const;
+    wxString GetTranslationMemoryPath() const;
+    bool UseApproximateMatching() const;
 private:
+    void AddPair(const stredit::vocab_pair& pair);
+
     wxButton * addButton;
     wxButton * removeButton;
     wxListCtrl * vocabPairList;
+    wxFilePickerCtrl * tmPicker;
+    wxCheckBox * approximateBox;
 
     DECLARE_EVENT_TABLE()
 };